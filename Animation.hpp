@@ -6,6 +6,7 @@
 #include "Physics/SphereCollider.hpp"
 #include "Physics/PlaneCollider.hpp"
 #include "Renderer/MeshRenderer.hpp"
+#include "Renderer/Animator.hpp"
 #include "Renderer/Camera.hpp"
 #include "Renderer/TextMesh.hpp"
 #include "Behaviour/LuaBehaviour.hpp"
@@ -38,6 +39,7 @@ void LoadScene(std::shared_ptr<entt::registry> registry)
 		auto entity = registry->create();
 		registry->assign<Transform>(entity, Vector3::zero, Vector3::one * 0.01f, Quaternion::identity);
 		registry->assign<MeshRenderer>(entity, "BlueMat", "Resources/walking.fbx");
+		registry->assign<Animator>(entity);
 	}
 
 }
\ No newline at end of file
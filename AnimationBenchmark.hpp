@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Renderer/MeshRenderer.hpp"
+#include "Renderer/Camera.hpp"
+#include "Renderer/Animator.hpp"
+#include "Renderer/PointLight.hpp"
+#include "Behaviour/LuaBehaviour.hpp"
+#include "Core/EntityName.hpp"
+
+// Stress scene for pose evaluation: a grid of walking.fbx instances, each with its own Animator.
+// Clip times and speeds are staggered so no two instances share a pose. Evaluation cost is shown in the profiler window.
+static const int kBenchmarkRows = 12;
+static const int kBenchmarkColumns = 12;
+
+void LoadScene(std::shared_ptr<entt::registry> registry)
+{
+	{
+		auto entity = registry->create();
+		registry->assign<EntityName>(entity, registry, "Main Camera");
+		registry->assign<Transform>(entity, Vector3(0.0f, 12.0f, -35.0f), Vector3::one, Quaternion(1, 0, 0, 0));
+		registry->assign<Camera>(entity);
+		registry->assign<LuaBehaviour>(entity, "Resources/FreeCam.lua");
+	}
+
+	{
+		auto entity = registry->create();
+		registry->assign<EntityName>(entity, registry, "Point Light");
+		registry->assign<Transform>(entity, Vector3::up * 10, Vector3::one * 0.25f, Quaternion::identity);
+		registry->assign<PointLight>(entity, Vector4::one, 30.0f, 5.0f, true);
+	}
+
+	{
+		auto entity = registry->create();
+		registry->assign<EntityName>(entity, registry, "Ground");
+		registry->assign<Transform>(entity, Vector3::zero, Vector3::one * 4.0f, Quaternion::identity);
+		registry->assign<MeshRenderer>(entity, "Resources/Engine/Materials/DefaultGrayGrid.material", "Resources/plane.obj");
+	}
+
+	for (int row = 0; row < kBenchmarkRows; row++)
+	{
+		for (int column = 0; column < kBenchmarkColumns; column++)
+		{
+			int index = row * kBenchmarkColumns + column;
+			Vector3 position((column - kBenchmarkColumns / 2) * 2.5f, 0.0f, (row - kBenchmarkRows / 2) * 2.5f);
+
+			auto entity = registry->create();
+			registry->assign<EntityName>(entity, registry, "Walker " + std::to_string(index));
+			registry->assign<Transform>(entity, position, Vector3::one * 0.01f, Quaternion::identity);
+			registry->assign<MeshRenderer>(entity, "Resources/Engine/Materials/AnimatedBlueGrid.material", "Resources/walking.fbx");
+
+			Animator& animator = registry->assign<Animator>(entity, 0, 0.8f + 0.4f * (float)(index % 7) / 6.0f);
+			animator.time = 0.137f * index;
+		}
+	}
+}
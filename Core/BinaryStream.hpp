@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <fstream>
+#include <filesystem>
+
+// Appends plain data to a byte buffer. Only trivially copyable types are written, in the machine's own byte order,
+// since cooked files are read back by the same build that wrote them.
+class BinaryWriter
+{
+public:
+	template<typename T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter only writes trivially copyable types");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	void WriteVector(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter only writes trivially copyable types");
+		Write((uint64_t)values.size());
+		WriteBytes(values.data(), values.size() * sizeof(T));
+	}
+
+	void WriteString(const std::string& value)
+	{
+		Write((uint64_t)value.size());
+		WriteBytes(value.data(), value.size());
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		size_t offset = buffer.size();
+		buffer.resize(offset + size);
+		memcpy(buffer.data() + offset, data, size);
+	}
+
+	const std::vector<uint8_t>& GetData() const { return buffer; }
+
+	// Written under a temporary name and renamed into place, so a half written file is never picked up
+	bool WriteToFile(const std::string& path) const
+	{
+		std::error_code error;
+		std::filesystem::path filePath(path);
+		std::filesystem::create_directories(filePath.parent_path(), error);
+
+		std::filesystem::path temporaryPath = filePath;
+		temporaryPath += ".tmp";
+
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+
+			if (!file)
+				return false;
+
+			file.write((const char*)buffer.data(), buffer.size());
+
+			if (!file)
+				return false;
+		}
+
+		std::filesystem::rename(temporaryPath, filePath, error);
+		return !error;
+	}
+private:
+	std::vector<uint8_t> buffer;
+};
+
+// Reads back what BinaryWriter wrote. Reading past the end marks the stream as failed and returns default values,
+// so a truncated file is detected once with IsValid rather than after every read.
+class BinaryReader
+{
+public:
+	BinaryReader(const uint8_t* data, size_t size) : data(data), size(size) {};
+
+	template<typename T>
+	T Read()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryReader only reads trivially copyable types");
+		T value = T();
+
+		if (const uint8_t* bytes = ReadBytes(sizeof(T)))
+			memcpy(&value, bytes, sizeof(T));
+
+		return value;
+	}
+
+	template<typename T>
+	void ReadVector(std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryReader only reads trivially copyable types");
+		uint64_t count = Read<uint64_t>();
+
+		if (!valid || count > (size - offset) / sizeof(T))
+		{
+			valid = false;
+			values.clear();
+			return;
+		}
+
+		values.resize((size_t)count);
+
+		if (count > 0)
+			memcpy(values.data(), ReadBytes((size_t)count * sizeof(T)), (size_t)count * sizeof(T));
+	}
+
+	std::string ReadString()
+	{
+		uint64_t length = Read<uint64_t>();
+		const char* bytes = (const char*)ReadBytes((size_t)length);
+		return bytes ? std::string(bytes, (size_t)length) : std::string();
+	}
+
+	// Returns a pointer into the underlying data, or nullptr if fewer than size bytes remain
+	const uint8_t* ReadBytes(size_t count)
+	{
+		if (!valid || count > size - offset)
+		{
+			valid = false;
+			return nullptr;
+		}
+
+		const uint8_t* bytes = data + offset;
+		offset += count;
+		return bytes;
+	}
+
+	bool IsValid() const { return valid; }
+private:
+	const uint8_t* data;
+	size_t size;
+	size_t offset = 0;
+	bool valid = true;
+};
@@ -1,7 +1,12 @@
 #include "ResourceManager.hpp"
+#include "ThreadPool.hpp"
+#include "../Renderer/TextureStreamer.hpp"
 
 ResourceManager* ResourceManager::s_Instance;
 
+// Large enough for a few textures or meshes a frame without a visible hitch
+static const size_t s_UploadBytesPerFrame = 16 * 1024 * 1024;
+
 ResourceManager::ResourceManager()
 {
 	ResourceManager::s_Instance = this;
@@ -31,6 +36,41 @@ std::shared_ptr<Texture> ResourceManager::GetTexture(std::string path)
 	return std::shared_ptr<Texture>(textures.find(path)->second);
 }
 
+void ResourceManager::LoadTextureAsync(std::string path)
+{
+	if (textures.find(path) != textures.end())
+		return;
+
+	if (ThreadPool::GetInstance() == nullptr)
+	{
+		LoadTexture(path);
+		return;
+	}
+
+	std::shared_ptr<Texture> placeholder = std::make_shared<Texture>();
+	textures.emplace(path, placeholder);
+	pendingLoads++;
+
+	ThreadPool::GetInstance()->Enqueue([this, path, placeholder]()
+	{
+		std::shared_ptr<TextureData> data = std::make_shared<TextureData>();
+
+		if (!Texture::Decode(path, *data, TextureStreamer::GetInstance() != nullptr))
+		{
+			QueueUpload(0, [] {});
+			return;
+		}
+
+		QueueUpload(data->pixels.size(), [placeholder, data]()
+		{
+			placeholder->Upload(*data);
+
+			if (placeholder->IsStreamed())
+				TextureStreamer::GetInstance()->Register(placeholder);
+		});
+	});
+}
+
 // Shader
 
 void ResourceManager::LoadShader(std::string path)
@@ -80,6 +120,40 @@ void ResourceManager::LoadMesh(std::string path)
 	meshes.emplace(path, resourcePointer);
 }
 
+void ResourceManager::LoadMeshAsync(std::string path)
+{
+	if (meshes.find(path) != meshes.end())
+		return;
+
+	if (ThreadPool::GetInstance() == nullptr)
+	{
+		LoadMesh(path);
+		return;
+	}
+
+	std::shared_ptr<Mesh> placeholder = std::make_shared<Mesh>();
+	meshes.emplace(path, placeholder);
+	pendingLoads++;
+
+	ThreadPool::GetInstance()->Enqueue([this, path, placeholder]()
+	{
+		// The placeholder is being drawn on the GL thread, so the mesh loads into its own object and is moved in after upload
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+
+		if (!mesh->LoadFromFile(path))
+		{
+			QueueUpload(0, [] {});
+			return;
+		}
+
+		QueueUpload(mesh->GetStagedSize(), [placeholder, mesh]()
+		{
+			mesh->UploadToGPU();
+			*placeholder = std::move(*mesh);
+		});
+	});
+}
+
 std::shared_ptr<Mesh> ResourceManager::GetMesh(std::string path)
 {
 	if (meshes.find(path) == meshes.end())
@@ -107,6 +181,39 @@ std::shared_ptr<Font> ResourceManager::GetFont(std::string path)
 	return std::shared_ptr<Font>(fonts.find(path)->second);
 }
 
+// Uploads
+
+void ResourceManager::QueueUpload(size_t size, std::function<void()> upload)
+{
+	std::lock_guard<std::mutex> lock(uploadsMutex);
+	uploads.push_back({ size, std::move(upload) });
+}
+
+void ResourceManager::Update()
+{
+	// At least one upload runs every frame so a resource larger than the budget still finishes
+	size_t uploadedBytes = 0;
+
+	while (uploadedBytes < s_UploadBytesPerFrame)
+	{
+		PendingUpload pending;
+
+		{
+			std::lock_guard<std::mutex> lock(uploadsMutex);
+
+			if (uploads.empty())
+				break;
+
+			pending = std::move(uploads.front());
+			uploads.pop_front();
+		}
+
+		pending.upload();
+		uploadedBytes += pending.size;
+		pendingLoads--;
+	}
+}
+
 std::string ResourceManager::ResourcePathFromMaterial(std::shared_ptr<Material> material)
 {
 	for (auto const& item : materials)
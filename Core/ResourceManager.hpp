@@ -10,6 +10,9 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <functional>
 
 class ResourceManager
 {
@@ -23,6 +26,15 @@ public:
 	void LoadMesh(std::string path);
 	void LoadFont(std::string path);
 
+	// Decode on the thread pool and upload from Update. Get* returns a placeholder straight away that becomes
+	// the real resource in place once its upload has run, so the pointer handed out never changes.
+	void LoadTextureAsync(std::string path);
+	void LoadMeshAsync(std::string path);
+
+	// Runs finished loads' GL uploads on the calling thread, up to a per-frame byte budget
+	void Update();
+	int GetPendingLoadCount() const { return pendingLoads; }
+
 	std::shared_ptr<Texture> GetTexture(std::string path);
 	std::shared_ptr<Shader> GetShader(std::string path);
 	std::shared_ptr<Material> GetMaterial(std::string path);
@@ -33,7 +45,18 @@ public:
 	std::string ResourcePathFromMesh(std::shared_ptr<Mesh> mesh);
 
 private:
+	struct PendingUpload
+	{
+		size_t size;
+		std::function<void()> upload;
+	};
+
+	void QueueUpload(size_t size, std::function<void()> upload);
+
 	static ResourceManager* s_Instance;
+	std::mutex uploadsMutex;
+	std::deque<PendingUpload> uploads;
+	int pendingLoads = 0;
 	std::map<std::string, std::shared_ptr<Texture>> textures;
 	std::map<std::string, std::shared_ptr<Shader>> shaders;
 	std::map<std::string, std::shared_ptr<Material>> materials;
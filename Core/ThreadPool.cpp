@@ -0,0 +1,133 @@
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+ThreadPool* ThreadPool::s_Instance;
+
+ThreadPool::ThreadPool() : ThreadPool(std::max(std::thread::hardware_concurrency(), 2u) - 1)
+{
+}
+
+ThreadPool::ThreadPool(unsigned int workerCount)
+{
+	ThreadPool::s_Instance = this;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+	}
+
+	jobsCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	if (ThreadPool::s_Instance == this)
+		ThreadPool::s_Instance = nullptr;
+}
+
+ThreadPool* ThreadPool::GetInstance()
+{
+	return ThreadPool::s_Instance;
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs.push_back(std::move(job));
+	}
+
+	jobsCondition.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+			if (stopping && jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)>& body)
+{
+	if (count == 0)
+		return;
+
+	chunkSize = std::max(chunkSize, (size_t)1);
+	size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	if (chunkCount == 1 || workers.empty())
+	{
+		body(0, count);
+		return;
+	}
+
+	// Chunks are claimed from a shared counter, so a helper that only starts after the work is done simply finds nothing left.
+	// The state is shared with the helpers because they can outlive this call.
+	struct ParallelForState
+	{
+		std::atomic<size_t> nextChunk{ 0 };
+		std::atomic<size_t> completedChunks{ 0 };
+	};
+
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	const std::function<void(size_t, size_t)>* bodyPointer = &body;
+
+	auto runChunks = [state, bodyPointer, count, chunkSize, chunkCount]()
+	{
+		size_t chunk;
+
+		while ((chunk = state->nextChunk.fetch_add(1)) < chunkCount)
+		{
+			size_t begin = chunk * chunkSize;
+			(*bodyPointer)(begin, std::min(begin + chunkSize, count));
+			state->completedChunks.fetch_add(1);
+		}
+	};
+
+	size_t helperCount = std::min(chunkCount - 1, workers.size());
+
+	for (size_t i = 0; i < helperCount; i++)
+		Enqueue(runChunks);
+
+	runChunks();
+
+	while (state->completedChunks.load() < chunkCount)
+		std::this_thread::yield();
+}
+
+void ThreadPool::ForEachChunk(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)>& body)
+{
+	if (s_Instance != nullptr)
+	{
+		s_Instance->ParallelFor(count, chunkSize, body);
+		return;
+	}
+
+	chunkSize = std::max(chunkSize, (size_t)1);
+
+	for (size_t begin = 0; begin < count; begin += chunkSize)
+		body(begin, std::min(begin + chunkSize, count));
+}
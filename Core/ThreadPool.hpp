@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ThreadPool
+{
+public:
+	ThreadPool();
+	ThreadPool(unsigned int workerCount);
+	~ThreadPool();
+	static ThreadPool* GetInstance();
+
+	void Enqueue(std::function<void()> job);
+
+	// Splits [0, count) into chunks of chunkSize and runs them on the workers and the calling thread.
+	// Returns once every chunk has finished.
+	void ParallelFor(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)>& body);
+
+	// ParallelFor on the instance when there is one, otherwise runs the chunks inline in order.
+	// The chunk index is begin / chunkSize either way.
+	static void ForEachChunk(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)>& body);
+
+	unsigned int GetWorkerCount() const { return (unsigned int)workers.size(); }
+private:
+	void WorkerLoop();
+
+	static ThreadPool* s_Instance;
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+	bool stopping = false;
+};
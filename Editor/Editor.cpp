@@ -9,13 +9,14 @@
 #include "HierarchyWindow.hpp"
 #include "InspectorWindow.hpp"
 #include "../Renderer/AmbientLight.hpp"
+#include "../Renderer/Animator.hpp"
 
 #include "../Vendor/imgui/imgui.h"
 #include "../Vendor/imgui/imgui_impl_glfw.h"
 #include "../Vendor/imgui/imgui_impl_opengl3.h"
 
-Editor::Editor(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderer, std::shared_ptr<PhysicsSystem> physicsSystem, std::shared_ptr<LuaSystem> luaSystem) :
-	registry(registry), renderer(renderer), physicsSystem(physicsSystem), luaSystem(luaSystem)
+Editor::Editor(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderer, std::shared_ptr<PhysicsSystem> physicsSystem, std::shared_ptr<LuaSystem> luaSystem, std::shared_ptr<AnimationSystem> animationSystem) :
+	registry(registry), renderer(renderer), physicsSystem(physicsSystem), luaSystem(luaSystem), animationSystem(animationSystem)
 {
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -31,7 +32,7 @@ Editor::Editor(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderS
 
 void Editor::AddWindows()
 {
-	windows.emplace_back(new ProfilerWindow);
+	windows.emplace_back(new ProfilerWindow(shared_from_this()));
 	windows.emplace_back(new ResourcesWindow(shared_from_this()));
 	windows.emplace_back(new InspectorWindow(shared_from_this()));
 	windows.emplace_back(new HierarchyWindow(shared_from_this()));
@@ -110,6 +111,11 @@ void Editor::Update()
 					AddComponent<MeshRenderer>();
 				}
 
+				if (ImGui::MenuItem("Animator"))
+				{
+					AddComponent<Animator>();
+				}
+
 				if (ImGui::MenuItem("Ambient Light"))
 				{
 					AddComponent<AmbientLight>();
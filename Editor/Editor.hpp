@@ -4,6 +4,7 @@
 #include "../Renderer/RenderSystem.hpp"
 #include "../Physics/PhysicsSystem.hpp"
 #include "../Behaviour/LuaSystem.hpp"
+#include "../Renderer/AnimationSystem.hpp"
 #include "EditorWindow.hpp"
 
 #include <functional>
@@ -11,7 +12,7 @@
 class Editor : public std::enable_shared_from_this<Editor>
 {
 public:
-	Editor(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderer, std::shared_ptr<PhysicsSystem> physicsSystem, std::shared_ptr<LuaSystem> luaSystem);
+	Editor(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderer, std::shared_ptr<PhysicsSystem> physicsSystem, std::shared_ptr<LuaSystem> luaSystem, std::shared_ptr<AnimationSystem> animationSystem);
 	~Editor();
 	void AddWindows();
 	void Update();
@@ -21,6 +22,7 @@ public:
 	std::shared_ptr<RenderSystem> renderer;
 	std::shared_ptr<PhysicsSystem> physicsSystem;
 	std::shared_ptr<LuaSystem> luaSystem;
+	std::shared_ptr<AnimationSystem> animationSystem;
 
 	void FocusEntity(entt::entity& entity);
 	void FocusResource(std::string resource);
@@ -14,7 +14,6 @@ public:
 	GameWindow(std::shared_ptr<Editor> editor) : editor(editor)
 	{
 		renderTexture = std::make_shared<Texture>(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
-		depthRenderbuffer = std::make_shared<Renderbuffer>(GL_DEPTH_COMPONENT24, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight());
 	};
 
 	const char* GetName() { return "Game"; };
@@ -104,9 +103,15 @@ public:
 		}
 
 		Window::GetInstance()->SetViewportDimensions(size.x, size.y);
-		renderTexture->Reformat(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
-		depthRenderbuffer->Reformat(GL_DEPTH_COMPONENT24, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight());
-		editor->renderer->RenderAll(renderTexture, depthRenderbuffer, cameraTransform, camera);
+
+		// The target is only re-specified when the window is resized
+		if (size.x != renderSize.x || size.y != renderSize.y)
+		{
+			renderTexture->Reformat(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
+			renderSize = size;
+		}
+
+		editor->renderer->RenderAll(renderTexture, cameraTransform, camera);
 		ImGui::Image((void*)renderTexture->GetTextureID(), size, ImVec2(0, 1), ImVec2(1, 0));
 		ImGui::End();
 	};
@@ -114,6 +119,6 @@ private:
 	bool isPlaying = false;
 	bool hasStarted = false;
 	std::shared_ptr<Texture> renderTexture;
-	std::shared_ptr<Renderbuffer> depthRenderbuffer;
+	ImVec2 renderSize;
 	std::shared_ptr<Editor> editor;
 };
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "../Renderer/AmbientLight.hpp"
 #include "../Renderer/DirectionalLight.hpp"
 #include "../Renderer/SpotLight.hpp"
+#include "../Renderer/Animator.hpp"
 
 #include "../Vendor/imgui/imgui.h"
 #include "../Vendor/imgui/imgui_impl_glfw.h"
@@ -46,6 +47,7 @@ public:
 			InputTransform(editor->registry->try_get<Transform>(selectedEntity));
 			InputCamera(editor->registry->try_get<Camera>(selectedEntity));
 			InputMeshRenderer(editor->registry->try_get<MeshRenderer>(selectedEntity));
+			InputAnimator(editor->registry->try_get<Animator>(selectedEntity));
 			InputPointLight(editor->registry->try_get<PointLight>(selectedEntity));
 			InputDirectionalLight(editor->registry->try_get<DirectionalLight>(selectedEntity));
 			InputSpotLight(editor->registry->try_get<SpotLight>(selectedEntity));
@@ -281,6 +283,25 @@ private:
 		}
 	}
 
+	void InputAnimator(Animator* animator)
+	{
+		if (animator == nullptr)
+			return;
+
+		if (ImGui::CollapsingHeader("Animator"))
+		{
+			ImGui::PushID("Animator");
+			ImGui::Text("Clip");
+			ImGui::InputInt("clip", &(animator->clip));
+			ImGui::Text("Time");
+			ImGui::DragFloat("time", &(animator->time), 0.005f, 0.0f, 1000.0f);
+			ImGui::Text("Speed");
+			ImGui::DragFloat("speed", &(animator->speed), 0.005f, -10.0f, 10.0f);
+			ImGui::Checkbox("Playing", &(animator->playing));
+			ImGui::PopID();
+		}
+	}
+
 	void InputCamera(Camera* camera)
 	{
 		if (camera == nullptr)
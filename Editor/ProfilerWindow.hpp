@@ -1,6 +1,9 @@
 #pragma once
 
 #include "EditorWindow.hpp"
+#include "../Renderer/RenderSystem.hpp"
+#include "../Core/ResourceManager.hpp"
+#include "../Renderer/TextureStreamer.hpp"
 
 #include "../Vendor/imgui/imgui.h"
 #include "../Vendor/imgui/imgui_impl_glfw.h"
@@ -9,6 +12,8 @@
 class ProfilerWindow : public EditorWindow
 {
 public:
+	ProfilerWindow(std::shared_ptr<Editor> editor) : editor(editor) {};
+
 	const char* GetName() { return "Profiler"; };
 
 	void Update()
@@ -32,9 +37,45 @@ public:
 		ImGui::Text("%f ms (%i fps)\n", ms, fps);
 		ImGui::PlotLines("", values, IM_ARRAYSIZE(values), values_offset, "", -1.0f, 1.0f, ImVec2(0, 80));
 
+		// The profiler draws before this frame's views have rendered
+		const RenderStats& stats = editor->renderer->GetLastFrameStats();
+		ImGui::Text("Meshes: %i visible, %i culled\n", stats.visibleMeshes, stats.culledMeshes);
+		ImGui::Text("State changes: %i shaders, %i materials\n", stats.shaderChanges, stats.materialChanges);
+		ImGui::Text("Draw calls: %i (%i instanced batches)\n", stats.drawCalls, stats.instancedBatches);
+		ImGui::Text("Triangles: %i (LODs %i / %i / %i / %i)\n", stats.triangles, stats.meshesPerLod[0], stats.meshesPerLod[1], stats.meshesPerLod[2], stats.meshesPerLod[3]);
+		float visibleTriangles = (float)std::max(stats.triangles, 1);
+		ImGui::Text("Vertex cache: ACMR %.3f (%.3f unoptimized)\n", stats.vertexCacheMisses / visibleTriangles, stats.unoptimizedVertexCacheMisses / visibleTriangles);
+		ImGui::Text("Shadow draws: %i (%i saved by culling)\n", stats.shadowDraws, stats.shadowDrawsSaved);
+		ImGui::Text("Shadow draw calls: %i\n", stats.shadowDrawCalls);
+		ImGui::Text("Shadow maps: %i rendered, %i cached\n", stats.shadowMapsRendered, stats.shadowMapsCached);
+		ImGui::Text("Shadow atlas: %i px, %.0f%% used\n", stats.shadowAtlasSize, 100.0f * stats.shadowAtlasUsedArea / ((float)stats.shadowAtlasSize * stats.shadowAtlasSize));
+		ImGui::Text("Render CPU: lights %.2f, shadows %.2f, gather %.2f, draw %.2f, overlay %.2f ms\n", stats.lightsMilliseconds, stats.shadowsMilliseconds, stats.gatherMilliseconds, stats.drawMilliseconds, stats.overlayMilliseconds);
+		ImGui::Text("Render passes: %i run, %i culled, %i pooled targets\n", stats.renderPasses, stats.culledRenderPasses, stats.pooledRenderTargets);
+
+		LightSettings* lightSettings = editor->renderer->GetLightSettings();
+		bool cullLightsOnCPU = lightSettings->GetCullOnCPU();
+		bool verifyLightCulling = lightSettings->GetVerifyCulling();
+
+		if (ImGui::Checkbox("Cull lights on CPU", &cullLightsOnCPU))
+			lightSettings->SetCullOnCPU(cullLightsOnCPU);
+
+		if (!cullLightsOnCPU && ImGui::Checkbox("Verify GPU light culling", &verifyLightCulling))
+			lightSettings->SetVerifyCulling(verifyLightCulling);
+
+		if (!cullLightsOnCPU && verifyLightCulling)
+			ImGui::Text("Light culling: %i of %i frames mismatched\n", lightSettings->GetMismatchedFrames(), lightSettings->GetVerifiedFrames());
+
+		const AnimationStats& animationStats = editor->animationSystem->GetStats();
+		ImGui::Text("Animation: %i poses in %.3f ms, %.1f KB of clips\n", animationStats.evaluatedPoses, animationStats.evaluationMilliseconds, animationStats.clipMemory / 1024.0f);
+		ImGui::Text("Loading: %i resources\n", ResourceManager::GetInstance()->GetPendingLoadCount());
+
+		const TextureStreamer* streamer = TextureStreamer::GetInstance();
+		ImGui::Text("Texture streaming: %.1f / %.1f MB (%i loading)\n", streamer->GetResidentSize() / (1024.0f * 1024.0f), streamer->GetBudget() / (1024.0f * 1024.0f), streamer->GetPendingLoadCount());
+
 		ImGui::End();
 	};
 private:
+	std::shared_ptr<Editor> editor;
 	float values[90];
 	int values_offset = 0;
 	double refresh_time = 0.0;
@@ -20,7 +20,6 @@ public:
 		camera = std::make_shared<Camera>();
 		cameraTransform = std::make_shared<Transform>(Vector3(0.0f, 5.0f, -25.0f), Vector3::one, Quaternion::identity);
 		renderTexture = std::make_shared<Texture>(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
-		depthRenderbuffer = std::make_shared<Renderbuffer>(GL_DEPTH_COMPONENT24, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight());
 	};
 
 	const char* GetName() { return "Scene"; };
@@ -79,15 +78,21 @@ public:
 		ImVec2 size = ImVec2(vMax.x - vMin.x, vMax.y - vMin.y);
 
 		Window::GetInstance()->SetViewportDimensions(size.x, size.y);
-		renderTexture->Reformat(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
-		depthRenderbuffer->Reformat(GL_DEPTH_COMPONENT24, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight());
-		editor->renderer->RenderAll(renderTexture, depthRenderbuffer, cameraTransform, camera);
+
+		// The target is only re-specified when the window is resized
+		if (size.x != renderSize.x || size.y != renderSize.y)
+		{
+			renderTexture->Reformat(Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), GL_RGB32F, GL_RGB);
+			renderSize = size;
+		}
+
+		editor->renderer->RenderAll(renderTexture, cameraTransform, camera);
 		ImGui::Image((void*)renderTexture->GetTextureID(), size, ImVec2(0, 1), ImVec2(1, 0));
 		ImGui::End();
 	};
 private:
 	std::shared_ptr<Texture> renderTexture;
-	std::shared_ptr<Renderbuffer> depthRenderbuffer;
+	ImVec2 renderSize;
 	std::shared_ptr<Editor> editor;
 	std::shared_ptr<Camera> camera;
 	std::shared_ptr<Transform> cameraTransform;
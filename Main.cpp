@@ -3,25 +3,84 @@
 
 #include "Renderer/Window.hpp"
 #include "Renderer/RenderSystem.hpp"
+#include "Renderer/AnimationSystem.hpp"
+#include "Renderer/RenderBenchmark.hpp"
 #include "Physics/PhysicsSystem.hpp"
 #include "Core/ResourceManager.hpp"
 #include "Core/Input.hpp"
+#include "Core/ThreadPool.hpp"
+#include "Renderer/TextureStreamer.hpp"
 #include "Vendor/entt/entt.hpp"
 #include "Behaviour/LuaSystem.hpp"
 #include "Editor/Editor.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 //#include "PBRDemo.hpp"
 //#include "Clustered.hpp"
 #include "Explosion.hpp"
 //#include "Animation.hpp"
+//#include "AnimationBenchmark.hpp"
 //#include "Shadows.hpp"
 //#include "SimpleMove.hpp"
 
-int main()
+// DaisyEngine --benchmark <frames> [--size <width> <height>] [--dump <folder> [interval]] [--report <file.csv>]
+// renders the scene offscreen without the editor and reports the time spent in each pass
+static bool ParseBenchmarkArguments(int argc, char** argv, RenderBenchmarkSettings& settings)
+{
+	bool benchmark = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+		{
+			benchmark = true;
+			settings.frames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+		{
+			settings.width = atoi(argv[++i]);
+			settings.height = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+		{
+			settings.dumpFolder = argv[++i];
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.dumpInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+		{
+			settings.reportPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--cpu-light-cull") == 0)
+		{
+			settings.cpuLightCulling = true;
+		}
+		else if (strcmp(argv[i], "--verify-light-cull") == 0)
+		{
+			settings.verifyLightCulling = true;
+		}
+	}
+
+	return benchmark;
+}
+
+int main(int argc, char** argv)
 {
+	RenderBenchmarkSettings benchmarkSettings;
+	bool runBenchmark = ParseBenchmarkArguments(argc, argv, benchmarkSettings);
+
 	ResourceManager resourceManager;
+	TextureStreamer textureStreamer;
+	ThreadPool threadPool;
 	Input inputSystem;
-	Window window("Daisy Engine", 1200, 700);
+	Window window("Daisy Engine", runBenchmark ? (float)benchmarkSettings.width : 1200, runBenchmark ? (float)benchmarkSettings.height : 700, runBenchmark);
+
+	if (!window.isOpen)
+		return 1;
+
 	auto registry = std::make_shared<entt::registry>();
 	
 	LoadScene(registry);
@@ -29,7 +88,15 @@ int main()
 	std::shared_ptr<PhysicsSystem> physicsSystem = std::make_shared<PhysicsSystem>();
 	std::shared_ptr<LuaSystem> luaSystem = std::make_shared<LuaSystem>(registry);
 	std::shared_ptr<RenderSystem> renderSystem = std::make_shared<RenderSystem>(registry);
-	std::shared_ptr<Editor> editor = std::make_shared<Editor>(registry, renderSystem, physicsSystem, luaSystem);
+	std::shared_ptr<AnimationSystem> animationSystem = std::make_shared<AnimationSystem>(registry);
+
+	if (runBenchmark)
+	{
+		RenderBenchmark benchmark(registry, renderSystem, animationSystem, benchmarkSettings);
+		return benchmark.Run() ? 0 : 1;
+	}
+
+	std::shared_ptr<Editor> editor = std::make_shared<Editor>(registry, renderSystem, physicsSystem, luaSystem, animationSystem);
 	editor->AddWindows();
 
 	bool runDebug = false;
@@ -45,6 +112,13 @@ int main()
 		window.ProcessInput();
 		window.Clear();
 
+		// Finished background loads replace their placeholders before anything is drawn this frame
+		resourceManager.Update();
+		textureStreamer.Update();
+
+		// Poses are evaluated once here and shared by every view and shadow pass rendered this frame
+		animationSystem->Update(Input::GetDeltaTime());
+		renderSystem->BeginFrame();
 		editor->Update();
 
 		window.SwapBuffers();
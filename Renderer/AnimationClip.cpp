@@ -0,0 +1,452 @@
+#include "AnimationClip.hpp"
+#include "../Core/BinaryStream.hpp"
+
+#include <assimp/scene.h>
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+// The three components kept by smallest three encoding always lie in [-1/sqrt(2), 1/sqrt(2)]
+static const float kSmallestThreeRange = 0.70710678f;
+static const float kRotationQuantization = 32767.0f;
+static const float kVectorQuantization = 65535.0f;
+
+struct KeyValue
+{
+	float v[4];
+};
+
+static KeyValue LerpKeys(const KeyValue& a, const KeyValue& b, float t)
+{
+	KeyValue result;
+
+	for (int i = 0; i < 4; i++)
+		result.v[i] = a.v[i] + (b.v[i] - a.v[i]) * t;
+
+	return result;
+}
+
+static KeyValue NlerpKeys(const KeyValue& a, const KeyValue& b, float t)
+{
+	KeyValue result = LerpKeys(a, b, t);
+	float length = sqrtf(result.v[0] * result.v[0] + result.v[1] * result.v[1] + result.v[2] * result.v[2] + result.v[3] * result.v[3]);
+
+	for (int i = 0; i < 4; i++)
+		result.v[i] /= length;
+
+	return result;
+}
+
+static float KeyError(const KeyValue& a, const KeyValue& b)
+{
+	float error = 0.0f;
+
+	for (int i = 0; i < 4; i++)
+		error = std::max(error, fabsf(a.v[i] - b.v[i]));
+
+	return error;
+}
+
+// Greedy reduction: walks forward from the last kept key and keeps a key only when interpolating across it
+// would move one of the skipped keys further than tolerance from its source value.
+template <class Interpolate>
+static std::vector<size_t> ReduceKeys(const std::vector<double>& times, const std::vector<KeyValue>& values, float tolerance, Interpolate interpolate)
+{
+	size_t count = values.size();
+	std::vector<size_t> kept;
+
+	if (count == 0)
+		return kept;
+
+	kept.push_back(0);
+
+	if (count == 1)
+		return kept;
+
+	size_t anchor = 0;
+
+	for (size_t candidate = 2; candidate < count; candidate++)
+	{
+		double span = times[candidate] - times[anchor];
+		bool withinTolerance = true;
+
+		for (size_t k = anchor + 1; k < candidate && withinTolerance; k++)
+		{
+			float t = span > 0.0 ? (float)((times[k] - times[anchor]) / span) : 0.0f;
+			withinTolerance = KeyError(interpolate(values[anchor], values[candidate], t), values[k]) <= tolerance;
+		}
+
+		if (!withinTolerance)
+		{
+			anchor = candidate - 1;
+			kept.push_back(anchor);
+		}
+	}
+
+	kept.push_back(count - 1);
+
+	// A track that never leaves tolerance of its first key collapses to a single key
+	if (kept.size() == 2)
+	{
+		bool constant = true;
+
+		for (size_t k = 1; k < count && constant; k++)
+			constant = KeyError(values[0], values[k]) <= tolerance;
+
+		if (constant)
+			kept.resize(1);
+	}
+
+	return kept;
+}
+
+static uint16_t Quantize(float value, float scale)
+{
+	return (uint16_t)std::min(std::max(value * scale + 0.5f, 0.0f), scale);
+}
+
+AnimationClip::AnimationClip(const aiAnimation* animation, const std::unordered_map<std::string, int32_t>& nodeIndices, size_t nodeCount, const ClipCompressionSettings& settings)
+{
+	duration = std::max((float)animation->mDuration, 0.0001f);
+	ticksPerSecond = (float)(animation->mTicksPerSecond != 0 ? animation->mTicksPerSecond : 25.0f);
+	nodeChannels.assign(nodeCount, -1);
+
+	for (uint32_t i = 0; i < animation->mNumChannels; i++)
+	{
+		const aiNodeAnim* channel = animation->mChannels[i];
+		auto node = nodeIndices.find(channel->mNodeName.data);
+
+		if (node == nodeIndices.end())
+			continue;
+
+		nodeChannels[node->second] = (int32_t)channels.size();
+		channels.emplace_back();
+
+		CompressedChannel& compressed = channels.back();
+		CompressVectorTrack(channel, false, settings.translationTolerance, compressed.translation);
+		CompressRotationTrack(channel, settings.rotationTolerance, compressed.rotation);
+		CompressVectorTrack(channel, true, settings.scaleTolerance, compressed.scale);
+
+		sourceKeyCount += channel->mNumPositionKeys + channel->mNumRotationKeys + channel->mNumScalingKeys;
+	}
+
+	compressedKeyCount = keyTimes.size();
+	channels.shrink_to_fit();
+	keyTimes.shrink_to_fit();
+	keyValues.shrink_to_fit();
+}
+
+size_t AnimationClip::GetMemoryUsage() const
+{
+	return sizeof(AnimationClip) + nodeChannels.capacity() * sizeof(int32_t) + channels.capacity() * sizeof(CompressedChannel)
+		+ (keyTimes.capacity() + keyValues.capacity()) * sizeof(uint16_t);
+}
+
+AnimationClip::AnimationClip(BinaryReader& reader)
+{
+	duration = reader.Read<float>();
+	ticksPerSecond = reader.Read<float>();
+	reader.ReadVector(nodeChannels);
+	reader.ReadVector(channels);
+	reader.ReadVector(keyTimes);
+	reader.ReadVector(keyValues);
+	compressedKeyCount = keyTimes.size();
+	sourceKeyCount = (size_t)reader.Read<uint64_t>();
+}
+
+bool AnimationClip::IsValid(size_t nodeCount) const
+{
+	if (nodeChannels.size() != nodeCount || keyValues.size() != keyTimes.size() * 4)
+		return false;
+
+	for (int32_t channel : nodeChannels)
+	{
+		if (channel < -1 || channel >= (int32_t)channels.size())
+			return false;
+	}
+
+	// Sampling always reads at least one key, and the ranges are checked in 64 bits so a huge count cannot wrap
+	auto inPool = [this](const KeyRange& keys) { return keys.count > 0 && (uint64_t)keys.first + keys.count <= keyTimes.size(); };
+
+	for (const CompressedChannel& channel : channels)
+	{
+		if (!inPool(channel.translation.keys) || !inPool(channel.rotation) || !inPool(channel.scale.keys))
+			return false;
+	}
+
+	return true;
+}
+
+void AnimationClip::Write(BinaryWriter& writer) const
+{
+	writer.Write(duration);
+	writer.Write(ticksPerSecond);
+	writer.WriteVector(nodeChannels);
+	writer.WriteVector(channels);
+	writer.WriteVector(keyTimes);
+	writer.WriteVector(keyValues);
+	writer.Write((uint64_t)sourceKeyCount);
+}
+
+uint16_t AnimationClip::QuantizeTime(double time) const
+{
+	return Quantize((float)(time / duration), kVectorQuantization);
+}
+
+void AnimationClip::CompressVectorTrack(const aiNodeAnim* channel, bool isScale, float tolerance, CompressedTrack& track)
+{
+	unsigned int keyCount = isScale ? channel->mNumScalingKeys : channel->mNumPositionKeys;
+	const aiVectorKey* keys = isScale ? channel->mScalingKeys : channel->mPositionKeys;
+
+	std::vector<double> times(keyCount);
+	std::vector<KeyValue> values(keyCount);
+
+	for (unsigned int i = 0; i < keyCount; i++)
+	{
+		times[i] = keys[i].mTime;
+		values[i] = { { keys[i].mValue.x, keys[i].mValue.y, keys[i].mValue.z, 0.0f } };
+	}
+
+	// Channels may animate only some of their tracks; an empty one holds the identity, as sampling needs a key
+	if (keyCount == 0)
+	{
+		float identity = isScale ? 1.0f : 0.0f;
+		times.push_back(0.0);
+		values.push_back({ { identity, identity, identity, 0.0f } });
+	}
+
+	std::vector<size_t> kept = ReduceKeys(times, values, tolerance, LerpKeys);
+
+	float rangeMax[4];
+
+	for (int c = 0; c < 4; c++)
+	{
+		track.rangeMin[c] = values[kept[0]].v[c];
+		rangeMax[c] = values[kept[0]].v[c];
+	}
+
+	for (size_t k : kept)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			track.rangeMin[c] = std::min(track.rangeMin[c], values[k].v[c]);
+			rangeMax[c] = std::max(rangeMax[c], values[k].v[c]);
+		}
+	}
+
+	float quantizeScale[4];
+
+	for (int c = 0; c < 4; c++)
+	{
+		float extent = rangeMax[c] - track.rangeMin[c];
+		track.rangeScale[c] = extent / kVectorQuantization;
+		quantizeScale[c] = extent > 0.0f ? 1.0f / extent : 0.0f;
+	}
+
+	track.keys.first = (uint32_t)keyTimes.size();
+	track.keys.count = (uint32_t)kept.size();
+
+	for (size_t k : kept)
+	{
+		keyTimes.push_back(QuantizeTime(times[k]));
+
+		for (int c = 0; c < 4; c++)
+			keyValues.push_back(Quantize((values[k].v[c] - track.rangeMin[c]) * quantizeScale[c], kVectorQuantization));
+	}
+}
+
+void AnimationClip::CompressRotationTrack(const aiNodeAnim* channel, float tolerance, KeyRange& keys)
+{
+	unsigned int keyCount = channel->mNumRotationKeys;
+	std::vector<double> times(keyCount);
+	std::vector<KeyValue> values(keyCount);
+
+	if (keyCount == 0)
+	{
+		times.push_back(0.0);
+		values.push_back({ { 0.0f, 0.0f, 0.0f, 1.0f } });
+	}
+
+	for (unsigned int i = 0; i < keyCount; i++)
+	{
+		const aiQuaternion& q = channel->mRotationKeys[i].mValue;
+		float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+		times[i] = channel->mRotationKeys[i].mTime;
+		values[i] = { { q.x / length, q.y / length, q.z / length, q.w / length } };
+
+		// Keep neighbouring keys in the same hemisphere so the reduction measures the short path between them
+		if (i > 0)
+		{
+			const KeyValue& previous = values[i - 1];
+			float dot = previous.v[0] * values[i].v[0] + previous.v[1] * values[i].v[1] + previous.v[2] * values[i].v[2] + previous.v[3] * values[i].v[3];
+
+			if (dot < 0.0f)
+			{
+				for (int c = 0; c < 4; c++)
+					values[i].v[c] = -values[i].v[c];
+			}
+		}
+	}
+
+	std::vector<size_t> kept = ReduceKeys(times, values, tolerance, NlerpKeys);
+
+	keys.first = (uint32_t)keyTimes.size();
+	keys.count = (uint32_t)kept.size();
+
+	for (size_t k : kept)
+	{
+		const KeyValue& value = values[k];
+		int largest = 0;
+
+		for (int c = 1; c < 4; c++)
+		{
+			if (fabsf(value.v[c]) > fabsf(value.v[largest]))
+				largest = c;
+		}
+
+		// q and -q are the same rotation, so the dropped component is made positive and rebuilt from the other three
+		float sign = value.v[largest] < 0.0f ? -1.0f : 1.0f;
+
+		keyTimes.push_back(QuantizeTime(times[k]));
+
+		for (int c = 0; c < 4; c++)
+		{
+			if (c != largest)
+				keyValues.push_back(Quantize((value.v[c] * sign + kSmallestThreeRange) / (2.0f * kSmallestThreeRange), kRotationQuantization));
+		}
+
+		keyValues.push_back((uint16_t)largest);
+	}
+}
+
+// Returns the index of the key starting the interval containing time. Playback usually advances by less than one
+// key per evaluation, so the cursor from the previous evaluation and its successor are tried before falling back
+// to a binary search, which handles looping and seeking.
+static uint32_t FindKey(float time, const uint16_t* times, uint32_t count, uint32_t& cursor)
+{
+	uint32_t lastInterval = count - 2;
+
+	if (cursor <= lastInterval && (float)times[cursor] <= time)
+	{
+		if (time < (float)times[cursor + 1])
+			return cursor;
+
+		if (cursor + 1 <= lastInterval && time < (float)times[cursor + 2])
+			return ++cursor;
+	}
+
+	const uint16_t* next = std::upper_bound(times + 1, times + count, time, [](float t, uint16_t key) { return t < (float)key; });
+	cursor = std::min((uint32_t)(next - (times + 1)), lastInterval);
+	return cursor;
+}
+
+static float IntervalFactor(float time, const uint16_t* times, uint32_t index)
+{
+	float span = (float)times[index + 1] - (float)times[index];
+
+	if (span <= 0.0f)
+		return 0.0f;
+
+	return std::min(std::max((time - (float)times[index]) / span, 0.0f), 1.0f);
+}
+
+static inline __m128 DecodeVector(const uint16_t* value, const CompressedTrack& track)
+{
+	__m128i widened = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)value), _mm_setzero_si128());
+	return _mm_add_ps(_mm_loadu_ps(track.rangeMin), _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_loadu_ps(track.rangeScale)));
+}
+
+static inline __m128 HorizontalSum(__m128 v)
+{
+	__m128 sum = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+static inline __m128 DecodeRotation(const uint16_t* value)
+{
+	// Lanes 0-2 hold the three kept components; lane 3 holds the index of the dropped one and is replaced below
+	__m128i widened = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)value), _mm_setzero_si128());
+	__m128 components = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(2.0f * kSmallestThreeRange / kRotationQuantization)), _mm_set1_ps(kSmallestThreeRange));
+	__m128 lane3 = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	components = _mm_andnot_ps(lane3, components);
+
+	// The dropped component was the largest and positive, so it is what makes the quaternion unit length
+	__m128 lengthSquared = HorizontalSum(_mm_mul_ps(components, components));
+	__m128 largest = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), lengthSquared), _mm_setzero_ps()));
+	__m128 packed = _mm_or_ps(components, _mm_and_ps(lane3, largest));
+
+	// Moves the largest component from lane 3 to where it was dropped from, keeping the others in order
+	switch (value[3] & 3)
+	{
+	case 0:
+		return _mm_shuffle_ps(packed, packed, _MM_SHUFFLE(2, 1, 0, 3));
+	case 1:
+		return _mm_shuffle_ps(packed, packed, _MM_SHUFFLE(2, 1, 3, 0));
+	case 2:
+		return _mm_shuffle_ps(packed, packed, _MM_SHUFFLE(2, 3, 1, 0));
+	default:
+		return packed;
+	}
+}
+
+Vector3 AnimationClip::SampleVectorTrack(const CompressedTrack& track, float time, uint32_t& cursor) const
+{
+	alignas(16) float result[4];
+	const uint16_t* values = &keyValues[(size_t)track.keys.first * 4];
+
+	if (track.keys.count == 1)
+	{
+		_mm_store_ps(result, DecodeVector(values, track));
+		return Vector3(result[0], result[1], result[2]);
+	}
+
+	const uint16_t* times = &keyTimes[track.keys.first];
+	uint32_t index = FindKey(time, times, track.keys.count, cursor);
+	__m128 start = DecodeVector(&values[index * 4], track);
+	__m128 end = DecodeVector(&values[(index + 1) * 4], track);
+	__m128 factor = _mm_set1_ps(IntervalFactor(time, times, index));
+
+	_mm_store_ps(result, _mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(end, start), factor)));
+	return Vector3(result[0], result[1], result[2]);
+}
+
+Quaternion AnimationClip::SampleRotationTrack(const KeyRange& keys, float time, uint32_t& cursor) const
+{
+	alignas(16) float result[4];
+	const uint16_t* values = &keyValues[(size_t)keys.first * 4];
+
+	if (keys.count == 1)
+	{
+		_mm_store_ps(result, DecodeRotation(values));
+		return Quaternion(result[3], result[0], result[1], result[2]);
+	}
+
+	const uint16_t* times = &keyTimes[keys.first];
+	uint32_t index = FindKey(time, times, keys.count, cursor);
+	__m128 start = DecodeRotation(&values[index * 4]);
+	__m128 end = DecodeRotation(&values[(index + 1) * 4]);
+
+	// Each key was encoded with its largest component positive, so take the short path between them
+	__m128 dot = HorizontalSum(_mm_mul_ps(start, end));
+	__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+	end = _mm_xor_ps(end, flip);
+
+	__m128 factor = _mm_set1_ps(IntervalFactor(time, times, index));
+	__m128 blended = _mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(end, start), factor));
+	blended = _mm_div_ps(blended, _mm_sqrt_ps(HorizontalSum(_mm_mul_ps(blended, blended))));
+
+	_mm_store_ps(result, blended);
+	return Quaternion(result[3], result[0], result[1], result[2]);
+}
+
+void AnimationClip::Sample(size_t node, float time, KeyCursor& cursor, Vector3& translation, Quaternion& rotation, Vector3& scale) const
+{
+	const CompressedChannel& channel = channels[nodeChannels[node]];
+
+	// Key times are stored as fractions of the duration in 16 bits
+	float normalizedTime = std::min(std::max(time / duration, 0.0f), 1.0f) * kVectorQuantization;
+
+	translation = SampleVectorTrack(channel.translation, normalizedTime, cursor.position);
+	rotation = SampleRotationTrack(channel.rotation, normalizedTime, cursor.rotation);
+	scale = SampleVectorTrack(channel.scale, normalizedTime, cursor.scaling);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#include "../Core/Math/Vector3.hpp"
+#include "../Core/Math/Quaternion.hpp"
+
+struct aiAnimation;
+struct aiNodeAnim;
+class BinaryReader;
+class BinaryWriter;
+
+// Last key interval found for each track of a channel
+struct KeyCursor
+{
+	uint32_t position = 0;
+	uint32_t rotation = 0;
+	uint32_t scaling = 0;
+};
+
+// Keys that linear interpolation of their neighbours reproduces within these tolerances are dropped.
+// Translation is in model units, rotation is per quaternion component.
+struct ClipCompressionSettings
+{
+	float translationTolerance = 0.001f;
+	float rotationTolerance = 0.001f;
+	float scaleTolerance = 0.0001f;
+};
+
+// A track's keys in the clip's key pool
+struct KeyRange
+{
+	uint32_t first = 0;
+	uint32_t count = 0;
+};
+
+// Vector values are quantized to 16 bits per component over the track's range
+struct CompressedTrack
+{
+	KeyRange keys;
+	float rangeMin[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float rangeScale[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+// Rotations use smallest three, storing three 15 bit components and the index of the dropped one, so need no range
+struct CompressedChannel
+{
+	CompressedTrack translation;
+	KeyRange rotation;
+	CompressedTrack scale;
+};
+
+class AnimationClip
+{
+public:
+	AnimationClip(const aiAnimation* animation, const std::unordered_map<std::string, int32_t>& nodeIndices, size_t nodeCount, const ClipCompressionSettings& settings = ClipCompressionSettings());
+
+	// Cooked clips are stored already compressed and bound to nodes
+	AnimationClip(BinaryReader& reader);
+	void Write(BinaryWriter& writer) const;
+	// Whether a clip read from a cooked file is bound to nodeCount nodes and every track stays inside the key pool
+	bool IsValid(size_t nodeCount) const;
+
+	float GetDuration() const { return duration / ticksPerSecond; }
+	float GetTicksPerSecond() const { return ticksPerSecond; }
+	bool HasChannel(size_t node) const { return nodeChannels[node] >= 0; }
+
+	// Samples the channel bound to node at time, in ticks. The node must have a channel.
+	void Sample(size_t node, float time, KeyCursor& cursor, Vector3& translation, Quaternion& rotation, Vector3& scale) const;
+
+	size_t GetSourceKeyCount() const { return sourceKeyCount; }
+	size_t GetCompressedKeyCount() const { return compressedKeyCount; }
+	size_t GetMemoryUsage() const;
+private:
+	void CompressVectorTrack(const aiNodeAnim* channel, bool isScale, float tolerance, CompressedTrack& track);
+	void CompressRotationTrack(const aiNodeAnim* channel, float tolerance, KeyRange& keys);
+	uint16_t QuantizeTime(double time) const;
+	Vector3 SampleVectorTrack(const CompressedTrack& track, float time, uint32_t& cursor) const;
+	Quaternion SampleRotationTrack(const KeyRange& keys, float time, uint32_t& cursor) const;
+
+	float duration;
+	float ticksPerSecond;
+	std::vector<int32_t> nodeChannels;
+	std::vector<CompressedChannel> channels;
+
+	// Every track's keys, one after another. Times are quantized to 16 bits over the clip duration; each key's value is
+	// four uint16_t at four times its index, so it decodes with a single 64 bit load.
+	std::vector<uint16_t> keyTimes;
+	std::vector<uint16_t> keyValues;
+	size_t sourceKeyCount = 0;
+	size_t compressedKeyCount = 0;
+};
@@ -0,0 +1,104 @@
+#include "AnimationSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Animator.hpp"
+#include "MeshRenderer.hpp"
+#include "BonePalette.hpp"
+#include "../Core/ThreadPool.hpp"
+
+static const size_t kPosesPerJob = 4;
+
+AnimationSystem::AnimationSystem(std::shared_ptr<entt::registry> registry) : registry(registry)
+{
+}
+
+void AnimationSystem::Update(float deltaTime)
+{
+	poseJobs.clear();
+
+	registry->view<MeshRenderer, Animator>().each([deltaTime, this](auto& meshRenderer, auto& animator)
+	{
+		const Mesh* mesh = meshRenderer.mesh.get();
+
+		if (mesh == nullptr || !mesh->IsAnimated())
+			return;
+
+		int clip = std::min(std::max(animator.clip, 0), mesh->GetClipCount() - 1);
+
+		// Cursors are only valid for the clip they were advanced on
+		if (animator.poseMesh != mesh || animator.poseClip != clip)
+		{
+			mesh->InitializePose(animator.pose);
+			animator.poseMesh = mesh;
+			animator.poseClip = clip;
+
+			if (!animator.bonePalette.initialized)
+				animator.bonePalette.Initialize(BONE_PALETTE_BINDING, sizeof(BonePaletteGLSL), (BonePaletteGLSL*)nullptr);
+		}
+
+		if (animator.playing)
+		{
+			float duration = mesh->GetClipDuration(clip);
+			animator.time += deltaTime * animator.speed;
+
+			if (duration > 0.0f)
+			{
+				animator.time = fmod(animator.time, duration);
+
+				if (animator.time < 0.0f)
+					animator.time += duration;
+			}
+		}
+
+		poseJobs.push_back({ mesh, &animator, clip });
+	});
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Every animator owns its pose buffers and meshes are only read, so instances evaluate independently on the workers
+	ThreadPool::ForEachChunk(poseJobs.size(), kPosesPerJob, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			PoseJob& job = poseJobs[i];
+			job.mesh->EvaluatePose(job.clip, job.animator->time, job.animator->pose);
+		}
+	});
+
+	stats.evaluatedPoses = (int)poseJobs.size();
+	stats.clipMemory = 0;
+	animatedMeshes.clear();
+
+	for (const PoseJob& job : poseJobs)
+		animatedMeshes.push_back(job.mesh);
+
+	std::sort(animatedMeshes.begin(), animatedMeshes.end());
+	animatedMeshes.erase(std::unique(animatedMeshes.begin(), animatedMeshes.end()), animatedMeshes.end());
+
+	for (const Mesh* mesh : animatedMeshes)
+		stats.clipMemory += mesh->GetClipMemoryUsage();
+	stats.evaluationMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// Uploads stay on the thread owning the GL context
+	for (PoseJob& job : poseJobs)
+	{
+		size_t boneCount = std::min(job.animator->pose.boneTransforms.size(), (size_t)MAX_BONES);
+		job.animator->bonePalette.Set(BONE_PALETTE_BINDING, sizeof(Matrix4x4) * boneCount, job.animator->pose.boneTransforms.data());
+	}
+}
+
+const UBO* AnimationSystem::GetBonePalette(entt::registry& registry, entt::entity entity, const Mesh* mesh)
+{
+	if (!mesh->IsAnimated())
+		return nullptr;
+
+	// Entities without an evaluated Animator are drawn in the mesh's rest pose
+	Animator* animator = registry.try_get<Animator>(entity);
+
+	if (animator != nullptr && animator->poseMesh == mesh)
+		return &animator->bonePalette;
+
+	return &mesh->GetRestPose();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../Vendor/entt/entt.hpp"
+
+class Mesh;
+class UBO;
+struct Animator;
+
+struct AnimationStats
+{
+	int evaluatedPoses = 0;
+	float evaluationMilliseconds = 0.0f;
+	// Compressed clips of the meshes being animated, counting each mesh once
+	size_t clipMemory = 0;
+};
+
+class AnimationSystem
+{
+public:
+	AnimationSystem(std::shared_ptr<entt::registry> registry);
+	void Update(float deltaTime);
+	const AnimationStats& GetStats() const { return stats; }
+	static const UBO* GetBonePalette(entt::registry& registry, entt::entity entity, const Mesh* mesh);
+private:
+	struct PoseJob
+	{
+		const Mesh* mesh;
+		Animator* animator;
+		int clip;
+	};
+
+	std::shared_ptr<entt::registry> registry;
+	std::vector<PoseJob> poseJobs;
+	std::vector<const Mesh*> animatedMeshes;
+	AnimationStats stats;
+};
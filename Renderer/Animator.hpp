@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Mesh.hpp"
+#include "UBO.hpp"
+
+// Per entity playback state for the animated mesh on the same entity's MeshRenderer.
+// AnimationSystem evaluates the pose once per frame; every pass that draws the entity binds bonePalette.
+struct Animator
+{
+	int clip;
+	float time;
+	float speed;
+	bool playing;
+
+	AnimationPose pose;
+	UBO bonePalette;
+	const Mesh* poseMesh = nullptr;
+	int poseClip = -1;
+
+	Animator(int clip, float speed) : clip(clip), time(0.0f), speed(speed), playing(true) {};
+	Animator() : clip(0), time(0.0f), speed(1.0f), playing(true) {};
+};
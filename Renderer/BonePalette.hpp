@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../Core/Math/Matrix4x4.hpp"
+
+// Skinned shaders declare "layout(std140) uniform BonePalette" and are bound to this point when compiled
+static const int BONE_PALETTE_BINDING = 1;
+static const char* const BONE_PALETTE_BLOCK_NAME = "BonePalette";
+static const int MAX_BONES = 100;
+
+struct BonePaletteGLSL
+{
+	Matrix4x4 boneTransforms[MAX_BONES];
+};
+
+static_assert(sizeof(BonePaletteGLSL) == MAX_BONES * 64, "BonePaletteGLSL must match the std140 layout of the BonePalette block");
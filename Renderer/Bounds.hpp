@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include "../Core/Math/Vector3.hpp"
+#include "../Core/Math/Matrix4x4.hpp"
+
+struct Bounds
+{
+	Vector3 center;
+	Vector3 extents;
+	float radius;
+
+	Bounds() : radius(0.0f) {};
+	Bounds(Vector3 center, Vector3 extents, float radius) : center(center), extents(extents), radius(radius) {};
+
+	Vector3 GetMin() const { return center - extents; }
+	Vector3 GetMax() const { return center + extents; }
+
+	// Transforms the box and sphere into the space of the given affine matrix (Arvo's method for the box).
+	Bounds Transformed(const Matrix4x4& matrix) const
+	{
+		Bounds result;
+		result.center = matrix.TransformPoint(center);
+
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			result.extents[i] =
+				fabsf(matrix(i, 0)) * extents.x +
+				fabsf(matrix(i, 1)) * extents.y +
+				fabsf(matrix(i, 2)) * extents.z;
+		}
+
+		float scaleX = matrix(0, 0) * matrix(0, 0) + matrix(1, 0) * matrix(1, 0) + matrix(2, 0) * matrix(2, 0);
+		float scaleY = matrix(0, 1) * matrix(0, 1) + matrix(1, 1) * matrix(1, 1) + matrix(2, 1) * matrix(2, 1);
+		float scaleZ = matrix(0, 2) * matrix(0, 2) + matrix(1, 2) * matrix(1, 2) + matrix(2, 2) * matrix(2, 2);
+		result.radius = radius * sqrtf(std::max(scaleX, std::max(scaleY, scaleZ)));
+
+		return result;
+	}
+};
@@ -0,0 +1,110 @@
+#include "Frustum.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 8; i++)
+	{
+		planeX[i] = planeY[i] = planeZ[i] = 0.0f;
+		planeW[i] = FLT_MAX;
+	}
+}
+
+Frustum::Frustum(const Matrix4x4& viewProjection) : Frustum()
+{
+	Set(viewProjection);
+}
+
+void Frustum::Set(const Matrix4x4& viewProjection)
+{
+	// Gribb/Hartmann plane extraction: each plane is row 3 plus or minus one of the other rows.
+	// Order: left, right, bottom, top, near, far.
+	for (int i = 0; i < 6; i++)
+	{
+		unsigned int row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+
+		float a = viewProjection(3, 0) + sign * viewProjection(row, 0);
+		float b = viewProjection(3, 1) + sign * viewProjection(row, 1);
+		float c = viewProjection(3, 2) + sign * viewProjection(row, 2);
+		float d = viewProjection(3, 3) + sign * viewProjection(row, 3);
+
+		float length = sqrtf(a * a + b * b + c * c);
+
+		planeX[i] = a / length;
+		planeY[i] = b / length;
+		planeZ[i] = c / length;
+		planeW[i] = d / length;
+	}
+
+	for (int i = 6; i < 8; i++)
+	{
+		planeX[i] = planeY[i] = planeZ[i] = 0.0f;
+		planeW[i] = FLT_MAX;
+	}
+}
+
+bool Frustum::IsSphereVisible(const Vector3& center, float radius) const
+{
+	__m128 cx = _mm_set1_ps(center.x);
+	__m128 cy = _mm_set1_ps(center.y);
+	__m128 cz = _mm_set1_ps(center.z);
+	__m128 negativeRadius = _mm_set1_ps(-radius);
+
+	for (int i = 0; i < 8; i += 4)
+	{
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_load_ps(planeX + i), cx), _mm_mul_ps(_mm_load_ps(planeY + i), cy)),
+			_mm_add_ps(_mm_mul_ps(_mm_load_ps(planeZ + i), cz), _mm_load_ps(planeW + i)));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(distance, negativeRadius)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool Frustum::IsBoxVisible(const Vector3& center, const Vector3& extents) const
+{
+	__m128 cx = _mm_set1_ps(center.x);
+	__m128 cy = _mm_set1_ps(center.y);
+	__m128 cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extents.x);
+	__m128 ey = _mm_set1_ps(extents.y);
+	__m128 ez = _mm_set1_ps(extents.z);
+	__m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int i = 0; i < 8; i += 4)
+	{
+		__m128 px = _mm_load_ps(planeX + i);
+		__m128 py = _mm_load_ps(planeY + i);
+		__m128 pz = _mm_load_ps(planeZ + i);
+
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+			_mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(planeW + i)));
+
+		// Projected half-size of the box onto the plane normal
+		__m128 projectedExtents = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+			_mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, projectedExtents), zero)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool Frustum::IsVisible(const Bounds& worldBounds) const
+{
+	// The sphere test is cheaper and rejects most objects; the box test tightens the result for elongated meshes.
+	if (!IsSphereVisible(worldBounds.center, worldBounds.radius))
+		return false;
+
+	return IsBoxVisible(worldBounds.center, worldBounds.extents);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../Core/Math/Matrix4x4.hpp"
+#include "Bounds.hpp"
+
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const Matrix4x4& viewProjection);
+	void Set(const Matrix4x4& viewProjection);
+	bool IsSphereVisible(const Vector3& center, float radius) const;
+	bool IsBoxVisible(const Vector3& center, const Vector3& extents) const;
+	bool IsVisible(const Bounds& worldBounds) const;
+private:
+	// Planes are stored structure-of-arrays and padded to 8 so they can be tested four at a time.
+	// The two padding planes always pass.
+	alignas(16) float planeX[8];
+	alignas(16) float planeY[8];
+	alignas(16) float planeZ[8];
+	alignas(16) float planeW[8];
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+#include <algorithm>
+
+#include "../Core/Math/Matrix4x4.hpp"
+
+static const int INSTANCE_DATA_BINDING = 4;
+static const char* const INSTANCE_DATA_BLOCK_NAME = "InstanceBuffer";
+
+// Shader storage buffer holding the model matrices of every instanced draw in a pass.
+// Shaders declaring the InstanceBuffer block read their model matrix as instanceModels[instanceOffset + gl_InstanceID].
+class InstanceBuffer
+{
+public:
+	void Upload(const std::vector<Matrix4x4>& models)
+	{
+		if (models.empty())
+			return;
+
+		if (ID == 0)
+			glGenBuffers(1, &ID);
+
+		size_t size = models.size() * sizeof(Matrix4x4);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+
+		// Orphan the previous storage so the upload never waits on draws still reading last frame's matrices
+		if (size > capacity)
+			capacity = std::max(size, capacity * 2);
+
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, models.data());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, ID);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+
+	void Bind()
+	{
+		if (ID != 0)
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, ID);
+	};
+private:
+	GLuint ID = 0;
+	size_t capacity = 0;
+};
@@ -0,0 +1,249 @@
+#include "LightCuller.hpp"
+#include "../Core/ThreadPool.hpp"
+#include "../Core/Math/Mathf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+static const size_t kClustersPerJob = 16;
+static const uint32_t kMaxLightsPerCluster = MAX_LIGHTS_PER_CLUSTER;
+
+static void Resize(std::vector<float>& values, size_t size)
+{
+	values.assign(size, 0.0f);
+}
+
+// Lanes past the end of the lights are padding and never count as hits
+static int ValidLanes(size_t first, size_t count)
+{
+	return count - first >= 4 ? 0xF : (1 << (count - first)) - 1;
+}
+
+// Same mapping as Screen2Eye in BuildLightGrid.glsl, always at the far end of the depth range
+static Vector4 ScreenToEye(const Matrix4x4& inverseProjection, float x, float y, float screenWidth, float screenHeight)
+{
+	Vector4 eye = inverseProjection * Vector4(2.0f * x / screenWidth - 1.0f, 2.0f * y / screenHeight - 1.0f, -3.0f, 1.0f);
+	return Vector4(eye.x / eye.w, eye.y / eye.w, eye.z / eye.w, 1.0f);
+}
+
+void LightCuller::BuildClusters(const Matrix4x4& projection, float near, float far, float screenWidth, float screenHeight, uint32_t clustersX, uint32_t clustersY, uint32_t clustersZ)
+{
+	this->clustersX = clustersX;
+	this->clustersY = clustersY;
+	this->clustersZ = clustersZ;
+	clusters.resize((size_t)clustersX * clustersY * clustersZ);
+
+	Matrix4x4 inverseProjection = Matrix4x4::AffineInverse(projection);
+	float clusterWidth = std::ceil(screenWidth / (float)clustersX);
+	float clusterHeight = std::ceil(screenHeight / (float)clustersY);
+
+	ThreadPool::ForEachChunk(clusters.size(), kClustersPerJob, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t x = (uint32_t)(i % clustersX);
+			uint32_t y = (uint32_t)(i / clustersX % clustersY);
+			uint32_t z = (uint32_t)(i / ((size_t)clustersX * clustersY));
+
+			Vector4 minEye = ScreenToEye(inverseProjection, x * clusterWidth, y * clusterHeight, screenWidth, screenHeight);
+			Vector4 maxEye = ScreenToEye(inverseProjection, (x + 1) * clusterWidth, (y + 1) * clusterHeight, screenWidth, screenHeight);
+
+			float clusterNear = near * std::pow(far / near, z / (float)clustersZ);
+			float clusterFar = near * std::pow(far / near, (z + 1) / (float)clustersZ);
+
+			float minNear = clusterNear / minEye.z;
+			float minFar = clusterFar / minEye.z;
+			float maxNear = clusterNear / maxEye.z;
+			float maxFar = clusterFar / maxEye.z;
+
+			Cluster& cluster = clusters[i];
+			cluster.minBounds = Vector4(
+				std::min(std::min(minEye.x * minNear, minEye.x * minFar), std::min(maxEye.x * maxNear, maxEye.x * maxFar)),
+				std::min(std::min(minEye.y * minNear, minEye.y * minFar), std::min(maxEye.y * maxNear, maxEye.y * maxFar)),
+				std::min(std::min(minEye.z * minNear, minEye.z * minFar), std::min(maxEye.z * maxNear, maxEye.z * maxFar)),
+				1.0f);
+			cluster.maxBounds = Vector4(
+				std::max(std::max(minEye.x * minNear, minEye.x * minFar), std::max(maxEye.x * maxNear, maxEye.x * maxFar)),
+				std::max(std::max(minEye.y * minNear, minEye.y * minFar), std::max(maxEye.y * maxNear, maxEye.y * maxFar)),
+				std::max(std::max(minEye.z * minNear, minEye.z * minFar), std::max(maxEye.z * maxNear, maxEye.z * maxFar)),
+				1.0f);
+		}
+	});
+}
+
+void LightCuller::CullLights(const Matrix4x4& view, const std::vector<PointLightGLSL>& pointLights, const std::vector<SpotLightGLSL>& spotLights, uint32_t maxLightIndices)
+{
+	// Into view space with z flipped, as the cull shader does per cluster
+	pointLightCount = pointLights.size();
+	size_t paddedCount = (pointLightCount + 3) & ~(size_t)3;
+	Resize(viewPointLights.x, paddedCount);
+	Resize(viewPointLights.y, paddedCount);
+	Resize(viewPointLights.z, paddedCount);
+	Resize(viewPointLights.radius, paddedCount);
+
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		const PointLightGLSL& light = pointLights[i];
+		Vector4 position = view * Vector4(light.position.x, light.position.y, light.position.z, 1.0f);
+		viewPointLights.x[i] = position.x;
+		viewPointLights.y[i] = position.y;
+		viewPointLights.z[i] = -position.z;
+		viewPointLights.radius[i] = light.radius;
+	}
+
+	spotLightCount = spotLights.size();
+	paddedCount = (spotLightCount + 3) & ~(size_t)3;
+
+	for (std::vector<float>* values : { &viewSpotLights.x, &viewSpotLights.y, &viewSpotLights.z, &viewSpotLights.directionX, &viewSpotLights.directionY,
+		&viewSpotLights.directionZ, &viewSpotLights.range, &viewSpotLights.cosAngle, &viewSpotLights.tanAngle })
+		Resize(*values, paddedCount);
+
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		const SpotLightGLSL& light = spotLights[i];
+		Vector4 position = view * Vector4(light.position.x, light.position.y, light.position.z, 1.0f);
+		Vector4 direction = view * Vector4(light.direction.x, light.direction.y, light.direction.z, 0.0f);
+		float directionLength = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		float angle = light.cutOff * kDegToRad;
+
+		viewSpotLights.x[i] = position.x;
+		viewSpotLights.y[i] = position.y;
+		viewSpotLights.z[i] = -position.z;
+		viewSpotLights.directionX[i] = direction.x / directionLength;
+		viewSpotLights.directionY[i] = direction.y / directionLength;
+		viewSpotLights.directionZ[i] = -direction.z / directionLength;
+		viewSpotLights.range[i] = light.range;
+		viewSpotLights.cosAngle[i] = std::cos(angle);
+		viewSpotLights.tanAngle[i] = std::tan(angle);
+	}
+
+	// Jobs build the lists of their clusters with offsets local to the job
+	clusterLights.resize(clusters.size());
+	jobIndices.resize((clusters.size() + kClustersPerJob - 1) / kClustersPerJob);
+
+	ThreadPool::ForEachChunk(clusters.size(), kClustersPerJob, [this](size_t begin, size_t end)
+	{
+		std::vector<uint32_t>& indices = jobIndices[begin / kClustersPerJob];
+		indices.clear();
+
+		for (size_t i = begin; i < end; i++)
+			CullCluster((uint32_t)i, indices);
+	});
+
+	// Then each cluster gets its run of the shared list in cluster order, trimmed like the shader once the list is full
+	uint32_t requestedCount = 0;
+	lightIndices.resize(1);
+
+	for (size_t job = 0; job < jobIndices.size(); job++)
+	{
+		const std::vector<uint32_t>& indices = jobIndices[job];
+		size_t end = std::min((job + 1) * kClustersPerJob, clusters.size());
+
+		for (size_t i = job * kClustersPerJob; i < end; i++)
+		{
+			ClusterLightsGLSL& lights = clusterLights[i];
+			uint32_t offset = requestedCount;
+			uint32_t available = offset < maxLightIndices ? maxLightIndices - offset : 0;
+			uint32_t pointCount = std::min(lights.pointLightCount, available);
+			uint32_t spotCount = std::min(lights.spotLightCount, available - pointCount);
+
+			lightIndices.insert(lightIndices.end(), indices.begin() + lights.pointLightOffset, indices.begin() + lights.pointLightOffset + pointCount);
+			lightIndices.insert(lightIndices.end(), indices.begin() + lights.spotLightOffset, indices.begin() + lights.spotLightOffset + spotCount);
+
+			requestedCount += lights.pointLightCount + lights.spotLightCount;
+			lights = { offset, pointCount, offset + pointCount, spotCount };
+		}
+	}
+
+	lightIndices[0] = requestedCount;
+}
+
+void LightCuller::CullCluster(uint32_t clusterIndex, std::vector<uint32_t>& indices)
+{
+	const Cluster& cluster = clusters[clusterIndex];
+	ClusterLightsGLSL& lights = clusterLights[clusterIndex];
+
+	// Point lights: squared distance from the light to the closest point of the box against the squared radius
+	__m128 minX = _mm_set1_ps(cluster.minBounds.x);
+	__m128 minY = _mm_set1_ps(cluster.minBounds.y);
+	__m128 minZ = _mm_set1_ps(cluster.minBounds.z);
+	__m128 maxX = _mm_set1_ps(cluster.maxBounds.x);
+	__m128 maxY = _mm_set1_ps(cluster.maxBounds.y);
+	__m128 maxZ = _mm_set1_ps(cluster.maxBounds.z);
+
+	lights.pointLightOffset = (uint32_t)indices.size();
+	lights.pointLightCount = 0;
+
+	for (size_t i = 0; i < pointLightCount && lights.pointLightCount < kMaxLightsPerCluster; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&viewPointLights.x[i]);
+		__m128 y = _mm_loadu_ps(&viewPointLights.y[i]);
+		__m128 z = _mm_loadu_ps(&viewPointLights.z[i]);
+		__m128 radius = _mm_loadu_ps(&viewPointLights.radius[i]);
+
+		__m128 dx = _mm_sub_ps(_mm_max_ps(minX, _mm_min_ps(x, maxX)), x);
+		__m128 dy = _mm_sub_ps(_mm_max_ps(minY, _mm_min_ps(y, maxY)), y);
+		__m128 dz = _mm_sub_ps(_mm_max_ps(minZ, _mm_min_ps(z, maxZ)), z);
+		__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_mul_ps(radius, radius))) & ValidLanes(i, pointLightCount);
+
+		for (int lane = 0; lane < 4 && lights.pointLightCount < kMaxLightsPerCluster; lane++)
+		{
+			if (hits & (1 << lane))
+			{
+				indices.push_back((uint32_t)(i + lane));
+				lights.pointLightCount++;
+			}
+		}
+	}
+
+	// Spot lights: the cone against the box's bounding sphere, culled by angle, beyond the range or behind the light
+	float extentsX = std::abs((cluster.maxBounds.x - cluster.minBounds.x) / 2.0f);
+	float extentsY = std::abs((cluster.maxBounds.y - cluster.minBounds.y) / 2.0f);
+	float extentsZ = std::abs((cluster.maxBounds.z - cluster.minBounds.z) / 2.0f);
+	float sphereRadius = std::sqrt(extentsX * extentsX + extentsY * extentsY + extentsZ * extentsZ);
+
+	__m128 centerX = _mm_set1_ps(cluster.minBounds.x + extentsX);
+	__m128 centerY = _mm_set1_ps(cluster.minBounds.y + extentsY);
+	__m128 centerZ = _mm_set1_ps(cluster.minBounds.z + extentsZ);
+	__m128 radius = _mm_set1_ps(sphereRadius);
+	__m128 negativeRadius = _mm_set1_ps(-sphereRadius);
+
+	lights.spotLightOffset = (uint32_t)indices.size();
+	lights.spotLightCount = 0;
+
+	for (size_t i = 0; i < spotLightCount && lights.spotLightCount < kMaxLightsPerCluster; i += 4)
+	{
+		__m128 vx = _mm_sub_ps(centerX, _mm_loadu_ps(&viewSpotLights.x[i]));
+		__m128 vy = _mm_sub_ps(centerY, _mm_loadu_ps(&viewSpotLights.y[i]));
+		__m128 vz = _mm_sub_ps(centerZ, _mm_loadu_ps(&viewSpotLights.z[i]));
+
+		__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		__m128 alongDirection = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(vx, _mm_loadu_ps(&viewSpotLights.directionX[i])),
+			_mm_mul_ps(vy, _mm_loadu_ps(&viewSpotLights.directionY[i]))),
+			_mm_mul_ps(vz, _mm_loadu_ps(&viewSpotLights.directionZ[i])));
+
+		// A negative square root gives NaN, which fails the comparison and keeps the light, as on the GPU
+		__m128 distanceClosestPoint = _mm_sub_ps(
+			_mm_mul_ps(_mm_loadu_ps(&viewSpotLights.cosAngle[i]), _mm_sqrt_ps(_mm_sub_ps(lengthSquared, _mm_mul_ps(alongDirection, alongDirection)))),
+			_mm_mul_ps(alongDirection, _mm_loadu_ps(&viewSpotLights.tanAngle[i])));
+
+		__m128 angleCull = _mm_cmpgt_ps(distanceClosestPoint, radius);
+		__m128 frontCull = _mm_cmpgt_ps(alongDirection, _mm_add_ps(radius, _mm_loadu_ps(&viewSpotLights.range[i])));
+		__m128 backCull = _mm_cmplt_ps(alongDirection, negativeRadius);
+
+		int hits = ~_mm_movemask_ps(_mm_or_ps(_mm_or_ps(angleCull, frontCull), backCull)) & ValidLanes(i, spotLightCount);
+
+		for (int lane = 0; lane < 4 && lights.spotLightCount < kMaxLightsPerCluster; lane++)
+		{
+			if (hits & (1 << lane))
+			{
+				indices.push_back((uint32_t)(i + lane));
+				lights.spotLightCount++;
+			}
+		}
+	}
+}
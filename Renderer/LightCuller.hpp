@@ -0,0 +1,53 @@
+#pragma once
+
+#include "LightSettings.hpp"
+#include "../Core/Math/Matrix4x4.hpp"
+
+#include <vector>
+#include <cstdint>
+
+// CPU counterpart of BuildLightGrid.glsl and CullLights.glsl. Fills the same cluster, ClusterLights and light index
+// buffers, so it can stand in where compute shaders are not available and serve as a reference for the GPU passes.
+class LightCuller
+{
+public:
+	void BuildClusters(const Matrix4x4& projection, float near, float far, float screenWidth, float screenHeight, uint32_t clustersX, uint32_t clustersY, uint32_t clustersZ);
+
+	// Needs BuildClusters first. Each cluster lists its lights in index order; the GPU pass finds the same sets in any order.
+	void CullLights(const Matrix4x4& view, const std::vector<PointLightGLSL>& pointLights, const std::vector<SpotLightGLSL>& spotLights, uint32_t maxLightIndices);
+
+	const std::vector<Cluster>& GetClusters() const { return clusters; }
+	const std::vector<ClusterLightsGLSL>& GetClusterLights() const { return clusterLights; }
+
+	// Laid out like the LightIndices buffer: the number of indices asked for, which is past the end of the list
+	// when it filled up, then the indices themselves
+	const std::vector<uint32_t>& GetLightIndices() const { return lightIndices; }
+private:
+	// Lights in view space stored structure-of-arrays and padded to a multiple of four, so they can be tested four at a time
+	struct PointLightsSoA
+	{
+		std::vector<float> x, y, z, radius;
+	};
+
+	struct SpotLightsSoA
+	{
+		std::vector<float> x, y, z, directionX, directionY, directionZ, range, cosAngle, tanAngle;
+	};
+
+	void CullCluster(uint32_t clusterIndex, std::vector<uint32_t>& indices);
+
+	uint32_t clustersX = 0;
+	uint32_t clustersY = 0;
+	uint32_t clustersZ = 0;
+	std::vector<Cluster> clusters;
+	std::vector<ClusterLightsGLSL> clusterLights;
+	std::vector<uint32_t> lightIndices;
+
+	PointLightsSoA viewPointLights;
+	SpotLightsSoA viewSpotLights;
+	size_t pointLightCount = 0;
+	size_t spotLightCount = 0;
+
+	// Each job appends the lists of its clusters here; they are joined once every job is done
+	std::vector<std::vector<uint32_t>> jobIndices;
+};
@@ -1,4 +1,5 @@
 #include "LightSettings.hpp"
+#include "LightCuller.hpp"
 #include "Window.hpp"
 
 #include "PointLight.hpp"
@@ -7,102 +8,288 @@
 #include "DirectionalLight.hpp"
 #include "../Core/Transform.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Lights are compared byte for byte against the last upload, so each one starts as zeroed memory to keep its padding stable
+template<typename T>
+static T& AddLight(std::vector<T>& lights)
+{
+	lights.emplace_back();
+	memset((void*)&lights.back(), 0, sizeof(T));
+	return lights.back();
+}
+
+template<typename T>
+static bool LightsChanged(const std::vector<T>& lights, const std::vector<T>& uploaded)
+{
+	return lights.size() != uploaded.size() || (!lights.empty() && memcmp(lights.data(), uploaded.data(), lights.size() * sizeof(T)) != 0);
+}
+
 LightSettings::LightSettings(std::shared_ptr<entt::registry> registry)
 {
 	this->registry = registry;
 	buildLightGrid = new ComputeShader("Resources/Engine/Compute/BuildLightGrid.glsl");
 	cullLights = new ComputeShader("Resources/Engine/Compute/CullLights.glsl");
+	lightCuller = new LightCuller();
+
+	// Allocated up front so the shaders have buffers bound before the first light shows up
+	pointLightSSBO.Orphan(1, sizeof(PointLightGLSL));
+	spotLightSSBO.Orphan(2, sizeof(SpotLightGLSL));
 
-	clustersSSBO.Initialize(0, sizeof(Cluster) * CLUSTER_COUNT, &clusterData);
-	pointLightData = new PointLightData();
-	spotLightData = new SpotLightData();
-	globalLightData = new GlobalLightData();
+	// The counts start at zero, so an empty scene never needs an upload
+	int counts[2] = { 0, 0 };
+	globalLightSSBO.Orphan(3, sizeof(GlobalLightData));
+	globalLightSSBO.SetRange(offsetof(GlobalLightData, numberOfAmbientLights), sizeof(counts), counts);
 }
 
 bool once = false;
 
+void LightSettings::SetClusterCounts(uint32_t x, uint32_t y, uint32_t z)
+{
+	clustersX = std::max(x, 1u);
+	clustersY = std::max(y, 1u);
+	clustersZ = std::max(z, 1u);
+	buffersDirty = true;
+}
+
+void LightSettings::SetLightLimits(uint32_t maxLights, uint32_t maxLightIndices)
+{
+	this->maxLights = maxLights;
+	this->maxLightIndices = maxLightIndices;
+	buffersDirty = true;
+}
+
 void LightSettings::Update(const Matrix4x4& projectionMatrix, const Matrix4x4& viewMatrix, const float near, const float far)
 {
+	uint32_t clusterCount = clustersX * clustersY * clustersZ;
+
+	if (buffersDirty)
+	{
+		clustersSSBO.Orphan(0, sizeof(Cluster) * clusterCount);
+		clusterLightsSSBO.Orphan(5, sizeof(ClusterLightsGLSL) * clusterCount);
+
+		// The list starts with the count the cull pass appends to
+		lightIndicesSSBO.Orphan(6, sizeof(uint32_t) * (1 + (size_t)maxLightIndices));
+		buffersDirty = false;
+	}
+
 	// Build Grid
 
-	buildLightGrid->Use();
+	if (cullOnCPU)
+	{
+		lightCuller->BuildClusters(projectionMatrix, near, far, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), clustersX, clustersY, clustersZ);
+		clustersSSBO.SetRange(0, lightCuller->GetClusters().size() * sizeof(Cluster), lightCuller->GetClusters().data());
+	}
+	else
+	{
+		buildLightGrid->Use();
 
-	buildLightGrid->SetVector2("clusterScreenSpaceSize",
-		std::ceil((float)Window::GetInstance()->GetViewportWidth() / (float)CLUSTERS_X),
-		std::ceil((float)Window::GetInstance()->GetViewportHeight() / (float)CLUSTERS_Y));
-	buildLightGrid->SetMatrix4x4("inverseProjection", Matrix4x4::AffineInverse(projectionMatrix));
-	buildLightGrid->SetFloat("nearPlane", near);
-	buildLightGrid->SetFloat("farPlane", far);
-	buildLightGrid->SetFloat("screenWidth", Window::GetInstance()->GetViewportWidth());
-	buildLightGrid->SetFloat("screenHeight", Window::GetInstance()->GetViewportHeight());
-	buildLightGrid->SetUVector3("clusterSizes", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+		buildLightGrid->SetVector2("clusterScreenSpaceSize",
+			std::ceil((float)Window::GetInstance()->GetViewportWidth() / (float)clustersX),
+			std::ceil((float)Window::GetInstance()->GetViewportHeight() / (float)clustersY));
+		buildLightGrid->SetMatrix4x4("inverseProjection", Matrix4x4::AffineInverse(projectionMatrix));
+		buildLightGrid->SetFloat("nearPlane", near);
+		buildLightGrid->SetFloat("farPlane", far);
+		buildLightGrid->SetFloat("screenWidth", Window::GetInstance()->GetViewportWidth());
+		buildLightGrid->SetFloat("screenHeight", Window::GetInstance()->GetViewportHeight());
+		buildLightGrid->SetUVector3("clusterSizes", clustersX, clustersY, clustersZ);
 
-	buildLightGrid->Dispatch(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+		buildLightGrid->Dispatch(clustersX, clustersY, clustersZ);
+	}
 
 	// Fill Point Light Buffer
 
-	int numPointLightsInScene = 0;
+	pointLights.clear();
 
-	registry->view<Transform, PointLight>().each([this, &numPointLightsInScene](auto& transform, auto& pointLight)
+	registry->view<Transform, PointLight>().each([this](auto& transform, auto& pointLight)
 	{
-		pointLightData->pointLights[numPointLightsInScene].position = Vector4 (transform.position.x, transform.position.y, transform.position.z, 1);
-		pointLightData->pointLights[numPointLightsInScene].color = pointLight.color;
-		pointLightData->pointLights[numPointLightsInScene].radius = pointLight.radius;
-		pointLightData->pointLights[numPointLightsInScene].intensity = pointLight.intensity;
-		pointLightData->pointLights[numPointLightsInScene].castsShadows = pointLight.castsShadows;
-		numPointLightsInScene++;
+		if (pointLights.size() >= maxLights)
+			return;
+
+		PointLightGLSL& light = AddLight(pointLights);
+		light.position = Vector4(transform.position.x, transform.position.y, transform.position.z, 1);
+		light.color = pointLight.color;
+		light.radius = pointLight.radius;
+		light.intensity = pointLight.intensity;
+		light.castsShadows = pointLight.castsShadows;
 	});
 
-	pointLightSSBO.Set(1, sizeof(PointLightData), pointLightData);
+	if (LightsChanged(pointLights, uploadedPointLights))
+	{
+		pointLightSSBO.Orphan(1, std::max(pointLights.size(), (size_t)1) * sizeof(PointLightGLSL));
+		pointLightSSBO.SetRange(0, pointLights.size() * sizeof(PointLightGLSL), pointLights.data());
+		uploadedPointLights = pointLights;
+	}
 
 	// Fill Spot Light Buffer
 
-	int numSpotLightsInScene = 0;
+	spotLights.clear();
 
-	registry->view<Transform, SpotLight>().each([this, &numSpotLightsInScene](auto& transform, auto& spotLight)
+	registry->view<Transform, SpotLight>().each([this](auto& transform, auto& spotLight)
 	{
+		if (spotLights.size() >= maxLights)
+			return;
+
 		Vector3 forward = transform.GetForward();
-		spotLightData->spotLights[numSpotLightsInScene].position = Vector4(transform.position.x, transform.position.y, transform.position.z, 1);
-		spotLightData->spotLights[numSpotLightsInScene].direction = Vector4(forward.x, forward.y, forward.z, 0);
-		spotLightData->spotLights[numSpotLightsInScene].color = Vector4(spotLight.color.x, spotLight.color.y, spotLight.color.z, 0);
-		spotLightData->spotLights[numSpotLightsInScene].intensity = spotLight.intensity;
-		spotLightData->spotLights[numSpotLightsInScene].cutOff = spotLight.cutOff;
-		spotLightData->spotLights[numSpotLightsInScene].range = spotLight.range;
-		numSpotLightsInScene++;
+		SpotLightGLSL& light = AddLight(spotLights);
+		light.position = Vector4(transform.position.x, transform.position.y, transform.position.z, 1);
+		light.direction = Vector4(forward.x, forward.y, forward.z, 0);
+		light.color = Vector4(spotLight.color.x, spotLight.color.y, spotLight.color.z, 0);
+		light.intensity = spotLight.intensity;
+		light.cutOff = spotLight.cutOff;
+		light.range = spotLight.range;
 	});
 
-	spotLightSSBO.Set(2, sizeof(SpotLightData), spotLightData);
+	if (LightsChanged(spotLights, uploadedSpotLights))
+	{
+		spotLightSSBO.Orphan(2, std::max(spotLights.size(), (size_t)1) * sizeof(SpotLightGLSL));
+		spotLightSSBO.SetRange(0, spotLights.size() * sizeof(SpotLightGLSL), spotLights.data());
+		uploadedSpotLights = spotLights;
+	}
 
 	// Fill Global Light Buffer
 
-	globalLightData->numberOfAmbientLights = 0;
+	ambientLights.clear();
 
 	registry->view<Transform, AmbientLight>().each([this](auto& transform, auto& ambientLight)
 	{
-		globalLightData->ambientLights[globalLightData->numberOfAmbientLights].color = Vector4(ambientLight.color.x, ambientLight.color.y, ambientLight.color.z,1);
-		globalLightData->ambientLights[globalLightData->numberOfAmbientLights].intensity = ambientLight.intensity;
-		globalLightData->numberOfAmbientLights++;
+		if (ambientLights.size() >= NUM_GLOBAL_LIGHTS)
+			return;
+
+		AmbientLightGLSL& light = AddLight(ambientLights);
+		light.color = Vector4(ambientLight.color.x, ambientLight.color.y, ambientLight.color.z, 1);
+		light.intensity = ambientLight.intensity;
 	});
 
-	globalLightData->numberOfDirectionalLights = 0;
+	directionalLights.clear();
 
 	registry->view<Transform, DirectionalLight>().each([this](auto& transform, auto& directionalLight)
 	{
+		if (directionalLights.size() >= NUM_GLOBAL_LIGHTS)
+			return;
+
 		Vector3 forward = transform.GetForward();
-		globalLightData->directionalLights[globalLightData->numberOfDirectionalLights].direction = Vector4(forward.x, forward.y, forward.z, 0);
-		globalLightData->directionalLights[globalLightData->numberOfDirectionalLights].color = Vector4(directionalLight.color.x, directionalLight.color.y, directionalLight.color.z, 1);
-		globalLightData->directionalLights[globalLightData->numberOfDirectionalLights].intensity = directionalLight.intensity;
-		globalLightData->numberOfDirectionalLights++;
+		DirectionalLightGLSL& light = AddLight(directionalLights);
+		light.direction = Vector4(forward.x, forward.y, forward.z, 0);
+		light.color = Vector4(directionalLight.color.x, directionalLight.color.y, directionalLight.color.z, 1);
+		light.intensity = directionalLight.intensity;
 	});
 
-	globalLightSSBO.Set(3, sizeof(GlobalLightData), globalLightData);
+	if (LightsChanged(ambientLights, uploadedAmbientLights) || LightsChanged(directionalLights, uploadedDirectionalLights))
+	{
+		int counts[2] = { (int)ambientLights.size(), (int)directionalLights.size() };
+
+		globalLightSSBO.Orphan(3, sizeof(GlobalLightData));
+		globalLightSSBO.SetRange(offsetof(GlobalLightData, ambientLights), ambientLights.size() * sizeof(AmbientLightGLSL), ambientLights.data());
+		globalLightSSBO.SetRange(offsetof(GlobalLightData, directionalLights), directionalLights.size() * sizeof(DirectionalLightGLSL), directionalLights.data());
+		globalLightSSBO.SetRange(offsetof(GlobalLightData, numberOfAmbientLights), sizeof(counts), counts);
+		uploadedAmbientLights = ambientLights;
+		uploadedDirectionalLights = directionalLights;
+	}
 
 	// Cull Lights
 
+	if (cullOnCPU)
+	{
+		lightCuller->CullLights(viewMatrix, pointLights, spotLights, maxLightIndices);
+		clusterLightsSSBO.SetRange(0, lightCuller->GetClusterLights().size() * sizeof(ClusterLightsGLSL), lightCuller->GetClusterLights().data());
+		lightIndicesSSBO.SetRange(0, lightCuller->GetLightIndices().size() * sizeof(uint32_t), lightCuller->GetLightIndices().data());
+		return;
+	}
+
+	uint32_t lightIndexCount = 0;
+	lightIndicesSSBO.SetRange(0, sizeof(lightIndexCount), &lightIndexCount);
+
 	cullLights->Use();
-	cullLights->SetUVector3("clusterSizes", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
-	cullLights->SetInt("numPointLights", numPointLightsInScene);
-	cullLights->SetInt("numSpotLights", numSpotLightsInScene);
+	cullLights->SetUVector3("clusterSizes", clustersX, clustersY, clustersZ);
+	cullLights->SetInt("numPointLights", (int)pointLights.size());
+	cullLights->SetInt("numSpotLights", (int)spotLights.size());
+	cullLights->SetInt("maxLightIndices", (int)maxLightIndices);
 	cullLights->SetMatrix4x4("view", viewMatrix);
-	cullLights->Dispatch(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+	cullLights->Dispatch(clustersX, clustersY, clustersZ);
+
+	if (verifyCulling)
+	{
+		verifiedFrames++;
+
+		if (VerifyCulling(projectionMatrix, viewMatrix, near, far) > 0)
+			mismatchedFrames++;
+	}
+}
+
+// The lights a cluster lists, sorted, since the compute pass appends them in whatever order its threads find them
+static std::vector<uint32_t> SortedClusterLights(const std::vector<uint32_t>& lightIndices, uint32_t offset, uint32_t count)
+{
+	std::vector<uint32_t> lights(lightIndices.begin() + 1 + offset, lightIndices.begin() + 1 + offset + count);
+	std::sort(lights.begin(), lights.end());
+	return lights;
+}
+
+static bool BoundsMatch(const Vector4& a, const Vector4& b)
+{
+	const float* x = &a.x;
+	const float* y = &b.x;
+
+	for (int c = 0; c < 3; c++)
+	{
+		if (fabsf(x[c] - y[c]) > 0.001f * std::max(1.0f, fabsf(x[c])))
+			return false;
+	}
+
+	return true;
+}
+
+int LightSettings::VerifyCulling(const Matrix4x4& projectionMatrix, const Matrix4x4& viewMatrix, float near, float far)
+{
+	uint32_t clusterCount = clustersX * clustersY * clustersZ;
+
+	std::vector<Cluster> gpuClusters(clusterCount);
+	std::vector<ClusterLightsGLSL> gpuClusterLights(clusterCount);
+	std::vector<uint32_t> gpuLightIndices(1 + (size_t)maxLightIndices);
+	clustersSSBO.Get(gpuClusters.size() * sizeof(Cluster), gpuClusters.data());
+	clusterLightsSSBO.Get(gpuClusterLights.size() * sizeof(ClusterLightsGLSL), gpuClusterLights.data());
+	lightIndicesSSBO.Get(gpuLightIndices.size() * sizeof(uint32_t), gpuLightIndices.data());
+
+	lightCuller->BuildClusters(projectionMatrix, near, far, Window::GetInstance()->GetViewportWidth(), Window::GetInstance()->GetViewportHeight(), clustersX, clustersY, clustersZ);
+	lightCuller->CullLights(viewMatrix, pointLights, spotLights, maxLightIndices);
+
+	const std::vector<Cluster>& cpuClusters = lightCuller->GetClusters();
+	const std::vector<ClusterLightsGLSL>& cpuClusterLights = lightCuller->GetClusterLights();
+	const std::vector<uint32_t>& cpuLightIndices = lightCuller->GetLightIndices();
+
+	// Which clusters lose their lights to a full list depends on the order the work groups ran in
+	if (gpuLightIndices[0] > maxLightIndices || cpuLightIndices[0] > maxLightIndices)
+	{
+		std::cout << "Light culling not verified: the light index list is full" << std::endl;
+		return 0;
+	}
+
+	int mismatches = 0;
+
+	for (uint32_t i = 0; i < clusterCount; i++)
+	{
+		const ClusterLightsGLSL& gpu = gpuClusterLights[i];
+		const ClusterLightsGLSL& cpu = cpuClusterLights[i];
+
+		bool boundsMatch = BoundsMatch(gpuClusters[i].minBounds, cpuClusters[i].minBounds) && BoundsMatch(gpuClusters[i].maxBounds, cpuClusters[i].maxBounds);
+		bool pointLightsMatch = SortedClusterLights(gpuLightIndices, gpu.pointLightOffset, gpu.pointLightCount) == SortedClusterLights(cpuLightIndices, cpu.pointLightOffset, cpu.pointLightCount);
+		bool spotLightsMatch = SortedClusterLights(gpuLightIndices, gpu.spotLightOffset, gpu.spotLightCount) == SortedClusterLights(cpuLightIndices, cpu.spotLightOffset, cpu.spotLightCount);
+
+		if (boundsMatch && pointLightsMatch && spotLightsMatch)
+			continue;
+
+		mismatches++;
+		std::cout << "Light culling mismatch in cluster " << i << ":"
+			<< (boundsMatch ? "" : " bounds")
+			<< (pointLightsMatch ? "" : " point lights (GPU " + std::to_string(gpu.pointLightCount) + ", CPU " + std::to_string(cpu.pointLightCount) + ")")
+			<< (spotLightsMatch ? "" : " spot lights (GPU " + std::to_string(gpu.spotLightCount) + ", CPU " + std::to_string(cpu.spotLightCount) + ")")
+			<< std::endl;
+	}
+
+	return mismatches;
 }
\ No newline at end of file
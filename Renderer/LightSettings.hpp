@@ -6,14 +6,21 @@
 #include "SSBO.hpp"
 #include "../Core/Math/Vector3.hpp"
 
+#include <vector>
+
+class LightCuller;
+
 struct Cluster
 {
 	Vector4 minBounds;
 	Vector4 maxBounds;
 };
 
-static const int NUM_LIGHTS = 256;
-static const int NUM_TILES = 512;
+// Ambient and directional lights are not clustered and keep a fixed array each
+static const int NUM_GLOBAL_LIGHTS = 256;
+
+// Must match maxLightsPerCluster in CullLights.glsl; a cluster touched by more lights of one type drops the rest
+static const int MAX_LIGHTS_PER_CLUSTER = 512;
 
 struct PointLightGLSL
 {
@@ -51,24 +58,19 @@ struct DirectionalLightGLSL
 	float padding[3];
 };
 
-struct PointLightData
+// Where each cluster's lights start in the shared light index list, and how many there are of each type
+struct ClusterLightsGLSL
 {
-	PointLightGLSL pointLights[NUM_LIGHTS];
-	int clusterPointLightCount[NUM_TILES];
-	int clusterPointLightIndices[NUM_TILES][NUM_LIGHTS];
-};
-
-struct SpotLightData
-{
-	SpotLightGLSL spotLights[NUM_LIGHTS];
-	int clusterSpotLightCount[NUM_TILES];
-	int clusterSpotLightIndices[NUM_TILES][NUM_LIGHTS];
+	uint32_t pointLightOffset;
+	uint32_t pointLightCount;
+	uint32_t spotLightOffset;
+	uint32_t spotLightCount;
 };
 
 struct GlobalLightData
 {
-	AmbientLightGLSL ambientLights[NUM_LIGHTS];
-	DirectionalLightGLSL directionalLights[NUM_LIGHTS];
+	AmbientLightGLSL ambientLights[NUM_GLOBAL_LIGHTS];
+	DirectionalLightGLSL directionalLights[NUM_GLOBAL_LIGHTS];
 	int numberOfAmbientLights;
 	int numberOfDirectionalLights;
 	int padding[2];
@@ -79,25 +81,62 @@ class LightSettings
 public:
 	LightSettings(std::shared_ptr<entt::registry> registry);
 	void Update(const Matrix4x4& projectionMatrix, const Matrix4x4& viewMatrix, const float near, const float far);
+
+	// Both take effect from the next Update. The index list holds every cluster's lights for one view;
+	// when it fills up, the clusters culled last lose their lights.
+	void SetClusterCounts(uint32_t x, uint32_t y, uint32_t z);
+	void SetLightLimits(uint32_t maxLights, uint32_t maxLightIndices);
+
+	uint32_t GetClustersX() const { return clustersX; }
+	uint32_t GetClustersY() const { return clustersY; }
+	uint32_t GetClustersZ() const { return clustersZ; }
+
+	// Builds and culls the clusters with LightCuller and uploads the result instead of running the compute passes
+	void SetCullOnCPU(bool cullOnCPU) { this->cullOnCPU = cullOnCPU; }
+	bool GetCullOnCPU() const { return cullOnCPU; }
+
+	// Reads the compute passes' results back after each Update and checks them against LightCuller, logging every
+	// cluster whose bounds or light sets differ. The readback stalls the frame, so this is only for testing.
+	void SetVerifyCulling(bool verifyCulling) { this->verifyCulling = verifyCulling; }
+	bool GetVerifyCulling() const { return verifyCulling; }
+	int GetVerifiedFrames() const { return verifiedFrames; }
+	int GetMismatchedFrames() const { return mismatchedFrames; }
 private:
+	// Returns the number of clusters that differ
+	int VerifyCulling(const Matrix4x4& projectionMatrix, const Matrix4x4& viewMatrix, float near, float far);
+
 	std::shared_ptr<entt::registry> registry;
 	ComputeShader* buildLightGrid;
 	ComputeShader* cullLights;
+	LightCuller* lightCuller;
+	bool cullOnCPU = false;
+	bool verifyCulling = false;
+	int verifiedFrames = 0;
+	int mismatchedFrames = 0;
+
+	uint32_t clustersX = 8;
+	uint32_t clustersY = 8;
+	uint32_t clustersZ = 8;
+	uint32_t maxLights = 16384;
+	uint32_t maxLightIndices = 262144;
+	bool buffersDirty = true;
 
-	static constexpr uint32_t CLUSTERS_X = 8;
-	static constexpr uint32_t CLUSTERS_Y = 8;
-	static constexpr uint32_t CLUSTERS_Z = 8;
-	static constexpr uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
-
-	Cluster clusterData[CLUSTER_COUNT];
 	SSBO clustersSSBO;
+	SSBO clusterLightsSSBO;
+	SSBO lightIndicesSSBO;
 
-	PointLightData* pointLightData;
+	// Only the lights themselves are uploaded, and only when they differ from last time
+	std::vector<PointLightGLSL> pointLights;
+	std::vector<PointLightGLSL> uploadedPointLights;
 	SSBO pointLightSSBO;
 
-	SpotLightData* spotLightData;
+	std::vector<SpotLightGLSL> spotLights;
+	std::vector<SpotLightGLSL> uploadedSpotLights;
 	SSBO spotLightSSBO;
 
-	GlobalLightData* globalLightData;
+	std::vector<AmbientLightGLSL> ambientLights;
+	std::vector<DirectionalLightGLSL> directionalLights;
+	std::vector<AmbientLightGLSL> uploadedAmbientLights;
+	std::vector<DirectionalLightGLSL> uploadedDirectionalLights;
 	SSBO globalLightSSBO;
 };
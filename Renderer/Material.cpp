@@ -1,5 +1,6 @@
 #include "Material.hpp"
 #include "../Core/ResourceManager.hpp"
+#include "TextureStreamer.hpp"
 #include "../Vendor/nlohmann/json.hpp"
 #include <fstream>
 
@@ -20,14 +21,15 @@ Material::Material(std::string filePath)
 
 void Material::SetTexture(std::string name, std::string value)
 {
+	ResourceManager::GetInstance()->LoadTextureAsync(value);
 	auto texturePointer = ResourceManager::GetInstance()->GetTexture(value);
-	MaterialTextureProperty property(name, texturePointer);
+	MaterialTextureProperty property(name, texturePointer, shader->GetTextureUnit(name));
 	textureProperties.push_back(property);
 }
 
 void Material::SetFloat(std::string name, float value)
 {
-	MaterialFloatProperty property(name, value);
+	MaterialFloatProperty property(name, value, shader->GetUniformHandle(name));
 	floatProperties.push_back(property);
 }
 
@@ -36,16 +38,26 @@ std::shared_ptr<Shader> Material::GetShader()
 	return shader;
 }
 
+void Material::RequestTextureSize(float pixels)
+{
+	TextureStreamer* streamer = TextureStreamer::GetInstance();
+
+	if (streamer == nullptr)
+		return;
+
+	for (const MaterialTextureProperty& property : textureProperties)
+		streamer->Request(property.value.get(), pixels);
+}
+
 void Material::Bind()
 {
 	for (int i = 0; i < textureProperties.size(); i++)
 	{
-		auto texture = textureProperties[i].value;
-		texture->Bind(shader->GetTextureUnit(textureProperties[i].name));
+		textureProperties[i].value->Bind(textureProperties[i].textureUnit);
 	}
 
 	for (int i = 0; i < floatProperties.size(); i++)
 	{
-		shader->SetFloat(floatProperties[i].name, floatProperties[i].value);
+		shader->SetFloat(floatProperties[i].handle, floatProperties[i].value);
 	}
 }
\ No newline at end of file
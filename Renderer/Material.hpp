@@ -10,16 +10,18 @@ struct MaterialTextureProperty
 {
 	std::string name;
 	std::shared_ptr<Texture> value;
+	int textureUnit;
 
-	MaterialTextureProperty(std::string n, std::shared_ptr<Texture> v) : name(n), value(v) {};
+	MaterialTextureProperty(std::string n, std::shared_ptr<Texture> v, int u) : name(n), value(v), textureUnit(u) {};
 };
 
 struct MaterialFloatProperty
 {
 	std::string name;
 	float value;
+	int handle;
 
-	MaterialFloatProperty(std::string n, float v) : name(n), value(v) {};
+	MaterialFloatProperty(std::string n, float v, int h) : name(n), value(v), handle(h) {};
 };
 
 class Material
@@ -30,6 +32,8 @@ public:
 	void SetFloat(std::string name, float value);
 	std::shared_ptr<Shader> GetShader();
 	void Bind();
+	// Tells the TextureStreamer how many pixels high the material is drawn this frame
+	void RequestTextureSize(float pixels);
 private:
 	std::shared_ptr<Shader> shader;
 	std::vector<MaterialTextureProperty> textureProperties;
@@ -1,5 +1,14 @@
 #include "Mesh.hpp"
 #include <glad/glad.h>
+#include <algorithm>
+#include <string>
+#include <cstring>
+
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+#include "../Core/MappedFile.hpp"
+#include "../Core/BinaryStream.hpp"
+#include "../Core/Hash.hpp"
 
 static const uint32_t s_MeshImportFlags =
 aiProcess_CalcTangentSpace |        // Create binormals/tangents just in case
@@ -10,6 +19,147 @@ aiProcess_GenUVCoords |             // Convert UVs if required
 aiProcess_OptimizeMeshes |          // Batch draws where possible
 aiProcess_ValidateDataStructure;    // Validation
 
+// Screen sizes below which each coarser level is used, and how far below a threshold a mesh must go before it switches
+static const float s_LodScreenSizes[MAX_MESH_LODS - 1] = { 0.25f, 0.12f, 0.05f };
+static const float s_LodHysteresis = 0.1f;
+
+// Simplification error allowed for each generated level, relative to the size of the submesh
+static const float s_LodMaxErrors[MAX_MESH_LODS - 1] = { 0.01f, 0.02f, 0.04f };
+
+bool Mesh::usePackedVertices = true;
+
+static uint32_t PackSnorm1010102(const Vector3& vector, float w)
+{
+	auto pack = [](float value, float scale, uint32_t mask) { return (uint32_t)(int32_t)roundf(std::min(std::max(value, -1.0f), 1.0f) * scale) & mask; };
+	return pack(vector.x, 511.0f, 0x3FF) | pack(vector.y, 511.0f, 0x3FF) << 10 | pack(vector.z, 511.0f, 0x3FF) << 20 | pack(w, 1.0f, 0x3) << 30;
+}
+
+static uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0)
+		return (uint16_t)sign;
+
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7C00);
+
+	// Round to nearest; a carry out of the mantissa correctly bumps the exponent
+	return (uint16_t)(sign + ((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+static void PackSharedAttributes(const Vector3& normal, const Vector3& tangent, const Vector3& binormal, const Vector2& texcoord, uint32_t& packedNormal, uint32_t& packedTangent, uint16_t* packedTexcoord)
+{
+	// The binormal is rebuilt in the shader as cross(normal, tangent.xyz) * tangent.w, so only its handedness is kept
+	float handedness = Vector3::Dot(Vector3::Cross(normal, tangent), binormal) < 0.0f ? -1.0f : 1.0f;
+
+	packedNormal = PackSnorm1010102(normal, 0.0f);
+	packedTangent = PackSnorm1010102(tangent, handedness);
+	packedTexcoord[0] = FloatToHalf(texcoord.x);
+	packedTexcoord[1] = FloatToHalf(texcoord.y);
+}
+
+static PackedVertex PackVertex(const Vertex& vertex)
+{
+	PackedVertex packed;
+	packed.Position = vertex.Position;
+	PackSharedAttributes(vertex.Normal, vertex.Tangent, vertex.Binormal, vertex.Texcoord, packed.Normal, packed.Tangent, packed.Texcoord);
+	return packed;
+}
+
+static PackedAnimatedVertex PackAnimatedVertex(const AnimatedVertex& vertex)
+{
+	PackedAnimatedVertex packed;
+	packed.Position = vertex.Position;
+	PackSharedAttributes(vertex.Normal, vertex.Tangent, vertex.Binormal, vertex.Texcoord, packed.Normal, packed.Tangent, packed.Texcoord);
+
+	// Weights are rounded to bytes and the rounding error given to the largest one so they still sum to one
+	int total = 0;
+	int largest = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		packed.IDs[i] = (uint8_t)std::min(vertex.IDs[i], (uint32_t)255);
+		packed.Weights[i] = (uint8_t)roundf(std::min(std::max(vertex.Weights[i], 0.0f), 1.0f) * 255.0f);
+		total += packed.Weights[i];
+
+		if (packed.Weights[i] > packed.Weights[largest])
+			largest = i;
+	}
+
+	if (total > 0)
+		packed.Weights[largest] = (uint8_t)std::min(std::max(packed.Weights[largest] + 255 - total, 0), 255);
+
+	return packed;
+}
+
+template<typename PackedVertexType>
+static void SetPackedVertexAttributes()
+{
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertexType), (void*)offsetof(PackedVertexType, Position));
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertexType), (void*)offsetof(PackedVertexType, Normal));
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertexType), (void*)offsetof(PackedVertexType, Tangent));
+
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertexType), (void*)offsetof(PackedVertexType, Texcoord));
+}
+
+// Cooked meshes are named after their source and keyed by its contents and every setting that affects the output
+static const uint32_t kCookedMeshMagic = 0x4D595344;
+static const uint32_t kCookedMeshVersion = 3;
+static const char* const s_CookedMeshFolder = "Cooked/Meshes/";
+
+static uint64_t CalculateCookKey(const std::string& filename)
+{
+	MappedFile source(filename);
+
+	if (!source.IsOpen())
+		return 0;
+
+	ClipCompressionSettings clipSettings;
+	int lodLevels = MAX_MESH_LODS;
+	uint8_t packedVertices = Mesh::usePackedVertices ? 1 : 0;
+
+	uint64_t key = HashBytes(source.GetData(), source.GetSize());
+	key = HashBytes(&kCookedMeshVersion, sizeof(kCookedMeshVersion), key);
+	key = HashBytes(&s_MeshImportFlags, sizeof(s_MeshImportFlags), key);
+	key = HashBytes(&packedVertices, sizeof(packedVertices), key);
+	key = HashBytes(&lodLevels, sizeof(lodLevels), key);
+	key = HashBytes(s_LodMaxErrors, sizeof(s_LodMaxErrors), key);
+	key = HashBytes(&clipSettings, sizeof(clipSettings), key);
+	return key;
+}
+
+static std::string GetCookedPath(const std::string& filename)
+{
+	std::string name = filename;
+
+	for (char& c : name)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+
+	return s_CookedMeshFolder + name + ".mesh";
+}
+
+template<typename T>
+static void AppendBytes(std::vector<uint8_t>& bytes, const std::vector<T>& values)
+{
+	const uint8_t* begin = (const uint8_t*)values.data();
+	bytes.insert(bytes.end(), begin, begin + values.size() * sizeof(T));
+}
+
 static Matrix4x4 aiMatrix4x4ToDSY(const aiMatrix4x4& from)
 {
 	Matrix4x4 result;
@@ -37,13 +187,181 @@ static Matrix4x4 aiMatrix4x4ToDSY(const aiMatrix4x4& from)
 	return result;
 }
 
-Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
+Mesh::Mesh(const std::string& filename)
+{
+	if (LoadFromFile(filename))
+		UploadToGPU();
+}
+
+bool Mesh::LoadFromFile(const std::string& filename)
+{
+	m_FilePath = filename;
+
+	uint64_t cookKey = CalculateCookKey(filename);
+	std::string cookedPath = GetCookedPath(filename);
+
+	if (LoadCooked(cookedPath, cookKey))
+		return true;
+
+	if (!Import(filename, staging.vertexData))
+		return false;
+
+	staging.vertices = staging.vertexData.data();
+	staging.verticesSize = staging.vertexData.size();
+	staging.indices = triangles.data();
+	staging.indicesSize = triangles.size() * sizeof(Triangle);
+
+	WriteCooked(cookedPath, cookKey, staging.vertexData);
+	return true;
+}
+
+void Mesh::UploadToGPU()
+{
+	Upload(staging.vertices, staging.verticesSize, staging.indices, staging.indicesSize);
+	staging = MeshStaging();
+
+	// The GPU holds the only copy of the geometry from here on
+	std::vector<Vertex>().swap(vertices);
+	std::vector<AnimatedVertex>().swap(m_AnimatedVertices);
+	std::vector<Triangle>().swap(triangles);
+
+	if (m_IsAnimated)
+	{
+		// Meshes drawn without an Animator use the first frame of the first clip
+		AnimationPose restPose;
+		InitializePose(restPose);
+		EvaluatePose(0, 0.0f, restPose);
+
+		size_t boneCount = std::min(restPose.boneTransforms.size(), (size_t)MAX_BONES);
+		m_RestPoseUBO.Initialize(BONE_PALETTE_BINDING, sizeof(BonePaletteGLSL), (BonePaletteGLSL*)nullptr);
+		m_RestPoseUBO.Set(BONE_PALETTE_BINDING, sizeof(Matrix4x4) * boneCount, restPose.boneTransforms.data());
+	}
+
+	loaded = true;
+}
+
+bool Mesh::LoadCooked(const std::string& cookedPath, uint64_t cookKey)
 {
-	importer = std::make_unique<Assimp::Importer>();
-	const aiScene* scene = importer->ReadFile(filename, s_MeshImportFlags);
+	std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>(cookedPath);
+
+	if (!file->IsOpen())
+		return false;
+
+	BinaryReader reader(file->GetData(), file->GetSize());
+
+	if (reader.Read<uint32_t>() != kCookedMeshMagic || reader.Read<uint64_t>() != cookKey)
+		return false;
+
+	m_IsAnimated = reader.Read<uint8_t>() != 0;
+	bounds = reader.Read<Bounds>();
+	reader.ReadVector(submeshes);
+	lodCount = std::min(std::max(reader.Read<int32_t>(), 1), MAX_MESH_LODS);
+
+	for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+		lodIndexCounts[lod] = reader.Read<uint32_t>();
+
+	unoptimizedACMR = reader.Read<float>();
+	vertexCacheACMR = reader.Read<float>();
+	bool clipsValid = true;
+
+	if (m_IsAnimated)
+	{
+		m_InverseTransform = reader.Read<Matrix4x4>();
+		m_BoneCount = reader.Read<uint32_t>();
+		reader.ReadVector(m_BoneInfo);
+		reader.ReadVector(m_Nodes);
+
+		uint64_t clipCount = reader.Read<uint64_t>();
+
+		for (uint64_t clip = 0; clip < clipCount && reader.IsValid(); clip++)
+		{
+			m_Clips.emplace_back(reader);
+
+			if (!m_Clips.back().IsValid(m_Nodes.size()))
+				clipsValid = false;
+		}
+	}
+
+	uint64_t vertexDataSize = reader.Read<uint64_t>();
+	const uint8_t* vertexData = reader.ReadBytes((size_t)vertexDataSize);
+	uint64_t indexDataSize = reader.Read<uint64_t>();
+	const uint8_t* indexData = reader.ReadBytes((size_t)indexDataSize);
+
+	if (!reader.IsValid() || reader.Read<uint32_t>() != kCookedMeshMagic || !clipsValid)
+	{
+		std::cout << "Cooked mesh " << cookedPath << " is corrupt, reimporting" << std::endl;
+
+		submeshes.clear();
+		m_BoneInfo.clear();
+		m_Nodes.clear();
+		m_Clips.clear();
+		m_BoneCount = 0;
+		lodCount = 1;
+		return false;
+	}
+
+	// The mapping is kept until upload so the pages go straight to the driver without an intermediate copy
+	staging.cookedFile = std::move(file);
+	staging.vertices = vertexData;
+	staging.verticesSize = (size_t)vertexDataSize;
+	staging.indices = indexData;
+	staging.indicesSize = (size_t)indexDataSize;
+	return true;
+}
+
+void Mesh::WriteCooked(const std::string& cookedPath, uint64_t cookKey, const std::vector<uint8_t>& vertexData) const
+{
+	if (cookKey == 0)
+		return;
+
+	BinaryWriter writer;
+	writer.Write(kCookedMeshMagic);
+	writer.Write(cookKey);
+	writer.Write((uint8_t)m_IsAnimated);
+	writer.Write(bounds);
+	writer.WriteVector(submeshes);
+	writer.Write((int32_t)lodCount);
+
+	for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+		writer.Write(lodIndexCounts[lod]);
+
+	writer.Write(unoptimizedACMR);
+	writer.Write(vertexCacheACMR);
+
+	if (m_IsAnimated)
+	{
+		writer.Write(m_InverseTransform);
+		writer.Write(m_BoneCount);
+		writer.WriteVector(m_BoneInfo);
+		writer.WriteVector(m_Nodes);
+		writer.Write((uint64_t)m_Clips.size());
+
+		for (const AnimationClip& clip : m_Clips)
+			clip.Write(writer);
+	}
+
+	writer.Write((uint64_t)vertexData.size());
+	writer.WriteBytes(vertexData.data(), vertexData.size());
+	writer.Write((uint64_t)(triangles.size() * sizeof(Triangle)));
+	writer.WriteBytes(triangles.data(), triangles.size() * sizeof(Triangle));
+
+	// A trailing magic catches files cut short while writing
+	writer.Write(kCookedMeshMagic);
+
+	if (!writer.WriteToFile(cookedPath))
+		std::cout << "Could not write cooked mesh " << cookedPath << std::endl;
+}
+
+bool Mesh::Import(const std::string& filename, std::vector<uint8_t>& vertexData)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(filename, s_MeshImportFlags);
 
 	if (scene == nullptr)
+	{
 		std::cout << "File: " << filename << " not found" << std::endl;
+		return false;
+	}
 
 	m_IsAnimated = scene->mAnimations != nullptr;
 	m_InverseTransform = Matrix4x4::AffineInverse(aiMatrix4x4ToDSY(scene->mRootNode->mTransformation));
@@ -62,6 +380,13 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 		submesh.BaseIndex = indexCount;
 		submesh.MaterialIndex = mesh->mMaterialIndex;
 		submesh.IndexCount = mesh->mNumFaces * 3;
+
+		for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+		{
+			submesh.LodBaseIndex[lod] = submesh.BaseIndex;
+			submesh.LodIndexCount[lod] = submesh.IndexCount;
+		}
+
 		submeshes.push_back(submesh);
 
 		vertexCount += mesh->mNumVertices;
@@ -116,6 +441,7 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 	}
 
 	TraverseNodes(scene->mRootNode);
+	CalculateBounds();
 
 	if (m_IsAnimated)
 	{
@@ -154,10 +480,69 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 			}
 		}
 	}
-	
-	if (vertexArrayObjectID >= 0)
-		glDeleteProgram(vertexArrayObjectID);
 
+	lodIndexCounts[0] = indexCount;
+
+	if (m_IsAnimated)
+	{
+		WeldVertices(m_AnimatedVertices);
+		OptimizeVertexOrder(m_AnimatedVertices);
+	}
+	else
+	{
+		// Skinned vertices move away from the bind pose, so only static meshes get simplified levels
+		WeldVertices(vertices);
+		GenerateLods();
+		OptimizeVertexOrder(vertices);
+	}
+
+	if (m_IsAnimated)
+	{
+		std::unordered_map<std::string, int32_t> nodeIndices;
+		BuildNodeHierarchy(scene->mRootNode, -1, nodeIndices);
+
+		// Clips are compressed and their channels bound to nodes once, so evaluation never touches the imported keys
+		m_Clips.reserve(scene->mNumAnimations);
+
+		for (uint32_t clip = 0; clip < scene->mNumAnimations; clip++)
+			m_Clips.emplace_back(scene->mAnimations[clip], nodeIndices, m_Nodes.size());
+	}
+
+	// Nothing below reads the scene, so its keys and vertices are freed before the vertex data is packed
+	importer.FreeScene();
+
+	if (m_IsAnimated && usePackedVertices)
+	{
+		std::vector<PackedAnimatedVertex> packedVertices(m_AnimatedVertices.size());
+
+		for (size_t i = 0; i < m_AnimatedVertices.size(); i++)
+			packedVertices[i] = PackAnimatedVertex(m_AnimatedVertices[i]);
+
+		AppendBytes(vertexData, packedVertices);
+	}
+	else if (usePackedVertices)
+	{
+		std::vector<PackedVertex> packedVertices(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); i++)
+			packedVertices[i] = PackVertex(vertices[i]);
+
+		AppendBytes(vertexData, packedVertices);
+	}
+	else if (m_IsAnimated)
+	{
+		AppendBytes(vertexData, m_AnimatedVertices);
+	}
+	else
+	{
+		AppendBytes(vertexData, vertices);
+	}
+
+	return true;
+}
+
+void Mesh::Upload(const void* vertexData, size_t vertexDataSize, const void* indexData, size_t indexDataSize)
+{
 	unsigned int VBO, EBO;
 
 	glGenVertexArrays(1, &vertexArrayObjectID);
@@ -166,14 +551,28 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 
 	glBindVertexArray(vertexArrayObjectID);
 
-	if (m_IsAnimated)
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexDataSize, indexData, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexDataSize, vertexData, GL_STATIC_DRAW);
+
+	if (m_IsAnimated && usePackedVertices)
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, m_AnimatedVertices.size() * sizeof(AnimatedVertex), &m_AnimatedVertices[0], GL_STATIC_DRAW);
+		SetPackedVertexAttributes<PackedAnimatedVertex>();
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(Triangle), &triangles[0], GL_STATIC_DRAW);
+		glEnableVertexAttribArray(5);
+		glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, sizeof(PackedAnimatedVertex), (void*)offsetof(PackedAnimatedVertex, IDs));
 
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedAnimatedVertex), (void*)offsetof(PackedAnimatedVertex, Weights));
+	}
+	else if (usePackedVertices)
+	{
+		SetPackedVertexAttributes<PackedVertex>();
+	}
+	else if (m_IsAnimated)
+	{
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(AnimatedVertex), (void*)0);
 
@@ -197,12 +596,6 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 	}
 	else
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(Triangle), &triangles[0], GL_STATIC_DRAW);
-
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
 
@@ -222,230 +615,358 @@ Mesh::Mesh(const std::string& filename) : m_FilePath(filename)
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	m_Scene = scene;
 }
 
-void Mesh::Render()
+void Mesh::CalculateBounds()
 {
-	glBindVertexArray(vertexArrayObjectID);
+	size_t vertexCount = m_IsAnimated ? m_AnimatedVertices.size() : vertices.size();
 
-	for (Submesh& submesh : submeshes)
+	if (vertexCount == 0)
+		return;
+
+	auto position = [this](size_t i) -> const Vector3& { return m_IsAnimated ? m_AnimatedVertices[i].Position : vertices[i].Position; };
+
+	Vector3 min = position(0);
+	Vector3 max = position(0);
+
+	for (size_t i = 1; i < vertexCount; i++)
 	{
-		glDrawElementsBaseVertex(GL_TRIANGLES, submesh.IndexCount, GL_UNSIGNED_INT, (void*)(sizeof(uint32_t) * submesh.BaseIndex), submesh.BaseVertex);
+		min = Vector3::Min(min, position(i));
+		max = Vector3::Max(max, position(i));
 	}
 
-	glBindVertexArray(0);
+	Vector3 center = (min + max) * 0.5f;
+	float radiusSquared = 0.0f;
+
+	for (size_t i = 0; i < vertexCount; i++)
+		radiusSquared = std::max(radiusSquared, Vector3::DistanceSquared(center, position(i)));
+
+	bounds = Bounds(center, (max - min) * 0.5f, sqrtf(radiusSquared));
+
+	// Bounds come from the bind pose, so leave room for skinned vertices to move during animation
+	if (m_IsAnimated)
+	{
+		bounds.extents = bounds.extents * 1.5f;
+		bounds.radius *= 1.5f;
+	}
 }
 
-void Mesh::Render(std::shared_ptr<Shader> shader, float deltaTime)
+template<typename VertexType>
+void Mesh::WeldVertices(std::vector<VertexType>& vertexData)
 {
-	if (m_IsAnimated)
+	// Vertices are imported per face corner, so identical ones are merged to give the simplifier connected surfaces
+	// and the post-transform cache something to reuse
+	std::vector<VertexType> weldedVertices;
+	weldedVertices.reserve(vertexData.size());
+
+	uint32_t* indices = reinterpret_cast<uint32_t*>(triangles.data());
+
+	for (size_t s = 0; s < submeshes.size(); s++)
 	{
-		if (m_AnimationPlaying)
-		{
-			m_WorldTime += deltaTime;
+		Submesh& submesh = submeshes[s];
+		size_t vertexEnd = s + 1 < submeshes.size() ? submeshes[s + 1].BaseVertex : vertexData.size();
 
-			float ticksPerSecond = (float)(m_Scene->mAnimations[0]->mTicksPerSecond != 0 ? m_Scene->mAnimations[0]->mTicksPerSecond : 25.0f) * m_TimeMultiplier;
-			m_AnimationTime += deltaTime * ticksPerSecond;
-			m_AnimationTime = fmod(m_AnimationTime, (float)m_Scene->mAnimations[0]->mDuration);
-		}
+		std::vector<uint32_t> remap(vertexEnd - submesh.BaseVertex);
+		uint32_t baseVertex = (uint32_t)weldedVertices.size();
 
-		BoneTransform(m_AnimationTime);
-	}
+		// Open addressing over the welded vertices, at most half full; slots hold an index into weldedVertices or ~0u
+		size_t tableSize = 1;
 
-	glBindVertexArray(vertexArrayObjectID);
+		while (tableSize < remap.size() * 2)
+			tableSize *= 2;
 
-	for (Submesh& submesh : submeshes)
-	{
-		if (m_IsAnimated)
+		std::vector<uint32_t> table(tableSize, ~0u);
+
+		for (size_t v = submesh.BaseVertex; v < vertexEnd; v++)
 		{
-			for (size_t i = 0; i < m_BoneTransforms.size(); i++)
+			size_t slot = HashBytes(&vertexData[v], sizeof(VertexType)) & (tableSize - 1);
+
+			while (table[slot] != ~0u && memcmp(&weldedVertices[table[slot]], &vertexData[v], sizeof(VertexType)) != 0)
+				slot = (slot + 1) & (tableSize - 1);
+
+			if (table[slot] == ~0u)
 			{
-				std::string uniformName = std::string("u_BoneTransforms[") + std::to_string(i) + std::string("]");
-				shader->SetMatrix4x4(uniformName, m_BoneTransforms[i]);
+				table[slot] = (uint32_t)weldedVertices.size();
+				weldedVertices.push_back(vertexData[v]);
 			}
+
+			remap[v - submesh.BaseVertex] = table[slot] - baseVertex;
 		}
 
-		glDrawElementsBaseVertex(GL_TRIANGLES, submesh.IndexCount, GL_UNSIGNED_INT, (void*)(sizeof(uint32_t) * submesh.BaseIndex), submesh.BaseVertex);
+		for (uint32_t i = submesh.BaseIndex; i < submesh.BaseIndex + submesh.IndexCount; i++)
+			indices[i] = remap[indices[i]];
+
+		submesh.BaseVertex = baseVertex;
 	}
 
-	glBindVertexArray(0);
+	vertexData.swap(weldedVertices);
 }
 
-void Mesh::TraverseNodes(aiNode* node, int level)
+template<typename VertexType>
+void Mesh::OptimizeVertexOrder(std::vector<VertexType>& vertexData)
 {
-	for (uint32_t i = 0; i < node->mNumMeshes; i++)
+	std::vector<VertexType> orderedVertices(vertexData.size());
+	uint32_t* indices = reinterpret_cast<uint32_t*>(triangles.data());
+
+	// Vertices transformed per triangle by level 0 of every submesh, before and after, kept for the profiler
+	float missesBefore = 0.0f;
+	float missesAfter = 0.0f;
+	float totalTriangles = 0.0f;
+
+	for (size_t s = 0; s < submeshes.size(); s++)
 	{
-		uint32_t mesh = node->mMeshes[i];
-		submeshes[mesh].Transform = aiMatrix4x4ToDSY(node->mTransformation);
+		Submesh& submesh = submeshes[s];
+		size_t vertexCount = (s + 1 < submeshes.size() ? submeshes[s + 1].BaseVertex : vertexData.size()) - submesh.BaseVertex;
+		float triangleCount = (float)(submesh.IndexCount / 3);
+		totalTriangles += triangleCount;
+
+		for (int lod = 0; lod < lodCount; lod++)
+		{
+			// Levels sharing the previous level's range were already handled with it
+			if (lod > 0 && submesh.LodBaseIndex[lod] == submesh.LodBaseIndex[lod - 1])
+				continue;
+
+			uint32_t* begin = indices + submesh.LodBaseIndex[lod];
+			std::vector<uint32_t> lodIndices(begin, begin + submesh.LodIndexCount[lod]);
+
+			if (lod == 0)
+				missesBefore += MeshOptimizer::CalculateACMR(lodIndices, vertexCount) * triangleCount;
+
+			MeshOptimizer::OptimizeVertexCache(lodIndices, vertexCount);
+			std::copy(lodIndices.begin(), lodIndices.end(), begin);
+
+			if (lod == 0)
+				missesAfter += MeshOptimizer::CalculateACMR(lodIndices, vertexCount) * triangleCount;
+		}
+
+		// Vertices are laid out in the order level 0 first uses them, so fetches walk the buffer mostly forwards
+		uint32_t* lod0 = indices + submesh.BaseIndex;
+		std::vector<uint32_t> remap = MeshOptimizer::BuildVertexFetchRemap(std::vector<uint32_t>(lod0, lod0 + submesh.IndexCount), vertexCount);
+
+		for (size_t v = 0; v < vertexCount; v++)
+			orderedVertices[submesh.BaseVertex + remap[v]] = vertexData[submesh.BaseVertex + v];
+
+		for (int lod = 0; lod < lodCount; lod++)
+		{
+			if (lod > 0 && submesh.LodBaseIndex[lod] == submesh.LodBaseIndex[lod - 1])
+				continue;
+
+			for (uint32_t i = submesh.LodBaseIndex[lod]; i < submesh.LodBaseIndex[lod] + submesh.LodIndexCount[lod]; i++)
+				indices[i] = remap[indices[i]];
+		}
 	}
 
-	for (uint32_t i = 0; i < node->mNumChildren; i++)
+	vertexData.swap(orderedVertices);
+
+	if (totalTriangles > 0.0f)
 	{
-		aiNode* child = node->mChildren[i];
-		TraverseNodes(child, level + 1);
+		unoptimizedACMR = missesBefore / totalTriangles;
+		vertexCacheACMR = missesAfter / totalTriangles;
 	}
 }
 
-uint32_t Mesh::FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim)
+void Mesh::GenerateLods()
 {
-	for (uint32_t i = 0; i < pNodeAnim->mNumPositionKeys - 1; i++)
+	std::vector<std::vector<uint32_t>> lodIndices[MAX_MESH_LODS];
+	const uint32_t* indices = reinterpret_cast<const uint32_t*>(triangles.data());
+
+	for (size_t s = 0; s < submeshes.size(); s++)
 	{
-		if (AnimationTime < (float)pNodeAnim->mPositionKeys[i + 1].mTime)
-			return i;
+		Submesh& submesh = submeshes[s];
+		size_t vertexEnd = s + 1 < submeshes.size() ? submeshes[s + 1].BaseVertex : vertices.size();
+
+		lodIndices[0].emplace_back(indices + submesh.BaseIndex, indices + submesh.BaseIndex + submesh.IndexCount);
+
+		std::vector<Vector3> positions(vertexEnd - submesh.BaseVertex);
+
+		for (size_t v = 0; v < positions.size(); v++)
+			positions[v] = vertices[submesh.BaseVertex + v].Position;
+
+		// Each level halves the previous one; once a level barely reduces the count, the submesh stops and its remaining
+		// levels are left empty, which makes them draw the last level it reached
+		for (int lod = 1; lod < MAX_MESH_LODS; lod++)
+		{
+			const std::vector<uint32_t>& previous = lodIndices[lod - 1][s];
+			std::vector<uint32_t> simplified;
+
+			if (!previous.empty())
+				simplified = MeshSimplifier::Simplify(positions.data(), positions.size(), previous, previous.size() / 6 * 3, s_LodMaxErrors[lod - 1]);
+
+			if (simplified.size() * 10 > previous.size() * 9)
+				simplified.clear();
+
+			if (!simplified.empty())
+				lodCount = std::max(lodCount, lod + 1);
+
+			lodIndices[lod].push_back(std::move(simplified));
+		}
 	}
 
-	return 0;
-}
+	// Levels are appended after the original indices, so level 0 keeps its place in the index buffer
+	for (int lod = 1; lod < lodCount; lod++)
+	{
+		lodIndexCounts[lod] = 0;
+
+		for (size_t s = 0; s < submeshes.size(); s++)
+		{
+			const std::vector<uint32_t>& levelIndices = lodIndices[lod][s];
+			Submesh& submesh = submeshes[s];
 
+			// A submesh that could not be simplified further shares the previous level's range instead of copying it
+			if (levelIndices.empty())
+			{
+				submesh.LodBaseIndex[lod] = submesh.LodBaseIndex[lod - 1];
+				submesh.LodIndexCount[lod] = submesh.LodIndexCount[lod - 1];
+				lodIndexCounts[lod] += submesh.LodIndexCount[lod];
+				continue;
+			}
 
-uint32_t Mesh::FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim)
+			submesh.LodBaseIndex[lod] = (uint32_t)triangles.size() * 3;
+			submesh.LodIndexCount[lod] = (uint32_t)levelIndices.size();
+			lodIndexCounts[lod] += (uint32_t)levelIndices.size();
+
+			for (size_t i = 0; i < levelIndices.size(); i += 3)
+				triangles.push_back({ levelIndices[i], levelIndices[i + 1], levelIndices[i + 2] });
+		}
+	}
+}
+
+int Mesh::SelectLod(float screenSize, int previousLod) const
 {
-	for (uint32_t i = 0; i < pNodeAnim->mNumRotationKeys - 1; i++)
+	int lod = 0;
+
+	while (lod + 1 < lodCount && screenSize < s_LodScreenSizes[lod])
+		lod++;
+
+	// Moving to a finer level happens at the threshold, moving to a coarser one only once the mesh is clearly past it
+	if (previousLod >= 0 && lod > previousLod)
 	{
-		if (AnimationTime < (float)pNodeAnim->mRotationKeys[i + 1].mTime)
-			return i;
+		lod = previousLod;
+
+		while (lod + 1 < lodCount && screenSize < s_LodScreenSizes[lod] * (1.0f - s_LodHysteresis))
+			lod++;
 	}
 
-	return 0;
+	return lod;
 }
 
-
-uint32_t Mesh::FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim)
+void Mesh::Render(int lod)
 {
-	for (uint32_t i = 0; i < pNodeAnim->mNumScalingKeys - 1; i++)
+	if (!loaded)
+		return;
+
+	glBindVertexArray(vertexArrayObjectID);
+
+	for (Submesh& submesh : submeshes)
 	{
-		if (AnimationTime < (float)pNodeAnim->mScalingKeys[i + 1].mTime)
-			return i;
+		glDrawElementsBaseVertex(GL_TRIANGLES, submesh.LodIndexCount[lod], GL_UNSIGNED_INT, (void*)(sizeof(uint32_t) * submesh.LodBaseIndex[lod]), submesh.BaseVertex);
 	}
 
-	return 0;
+	glBindVertexArray(0);
 }
 
-Vector3 Mesh::InterpolateTranslation(float animationTime, const aiNodeAnim* nodeAnim)
+void Mesh::RenderInstanced(int instanceCount, int lod)
 {
-	if (nodeAnim->mNumPositionKeys == 1)
-	{
-		// No interpolation necessary for single value
-		auto v = nodeAnim->mPositionKeys[0].mValue;
-		return { v.x, v.y, v.z };
-	}
+	if (!loaded)
+		return;
 
-	uint32_t PositionIndex = FindPosition(animationTime, nodeAnim);
-	uint32_t NextPositionIndex = (PositionIndex + 1);
+	glBindVertexArray(vertexArrayObjectID);
 
-	float DeltaTime = (float)(nodeAnim->mPositionKeys[NextPositionIndex].mTime - nodeAnim->mPositionKeys[PositionIndex].mTime);
-	float Factor = (animationTime - (float)nodeAnim->mPositionKeys[PositionIndex].mTime) / DeltaTime;
-	if (Factor < 0.0f)
-		Factor = 0.0f;
+	for (Submesh& submesh : submeshes)
+	{
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, submesh.LodIndexCount[lod], GL_UNSIGNED_INT, (void*)(sizeof(uint32_t) * submesh.LodBaseIndex[lod]), instanceCount, submesh.BaseVertex);
+	}
 
-	const aiVector3D& Start = nodeAnim->mPositionKeys[PositionIndex].mValue;
-	const aiVector3D& End = nodeAnim->mPositionKeys[NextPositionIndex].mValue;
-	aiVector3D Delta = End - Start;
-	auto aiVec = Start + Factor * Delta;
-	return { aiVec.x, aiVec.y, aiVec.z };
+	glBindVertexArray(0);
 }
 
-
-Quaternion Mesh::InterpolateRotation(float animationTime, const aiNodeAnim* nodeAnim)
+void Mesh::TraverseNodes(aiNode* node, int level)
 {
-	if (nodeAnim->mNumRotationKeys == 1)
+	for (uint32_t i = 0; i < node->mNumMeshes; i++)
 	{
-		// No interpolation necessary for single value
-		auto v = nodeAnim->mRotationKeys[0].mValue;
-		return Quaternion(v.w, v.x, v.y, v.z);
+		uint32_t mesh = node->mMeshes[i];
+		submeshes[mesh].Transform = aiMatrix4x4ToDSY(node->mTransformation);
 	}
 
-	uint32_t RotationIndex = FindRotation(animationTime, nodeAnim);
-	uint32_t NextRotationIndex = (RotationIndex + 1);
-
-	float DeltaTime = (float)(nodeAnim->mRotationKeys[NextRotationIndex].mTime - nodeAnim->mRotationKeys[RotationIndex].mTime);
-	float Factor = (animationTime - (float)nodeAnim->mRotationKeys[RotationIndex].mTime) / DeltaTime;
-	if (Factor < 0.0f)
-		Factor = 0.0f;
-
-	const aiQuaternion& StartRotationQ = nodeAnim->mRotationKeys[RotationIndex].mValue;
-	const aiQuaternion& EndRotationQ = nodeAnim->mRotationKeys[NextRotationIndex].mValue;
-	auto q = aiQuaternion();
-	aiQuaternion::Interpolate(q, StartRotationQ, EndRotationQ, Factor);
-	q = q.Normalize();
-	return Quaternion(q.w, q.x, q.y, q.z);
+	for (uint32_t i = 0; i < node->mNumChildren; i++)
+	{
+		aiNode* child = node->mChildren[i];
+		TraverseNodes(child, level + 1);
+	}
 }
 
-
-Vector3 Mesh::InterpolateScale(float animationTime, const aiNodeAnim* nodeAnim)
+void Mesh::BuildNodeHierarchy(const aiNode* node, int32_t parent, std::unordered_map<std::string, int32_t>& nodeIndices)
 {
-	if (nodeAnim->mNumScalingKeys == 1)
-	{
-		// No interpolation necessary for single value
-		auto v = nodeAnim->mScalingKeys[0].mValue;
-		return { v.x, v.y, v.z };
-	}
+	// Nodes are stored depth first, so a parent always precedes its children
+	std::string name(node->mName.data);
+
+	AnimationNode animationNode;
+	animationNode.parent = parent;
+	animationNode.bone = -1;
+	animationNode.localTransform = aiMatrix4x4ToDSY(node->mTransformation);
 
-	uint32_t index = FindScaling(animationTime, nodeAnim);
-	uint32_t nextIndex = (index + 1);
+	auto bone = m_BoneMapping.find(name);
 
-	float deltaTime = (float)(nodeAnim->mScalingKeys[nextIndex].mTime - nodeAnim->mScalingKeys[index].mTime);
-	float factor = (animationTime - (float)nodeAnim->mScalingKeys[index].mTime) / deltaTime;
-	if (factor < 0.0f)
-		factor = 0.0f;
+	if (bone != m_BoneMapping.end())
+		animationNode.bone = (int32_t)bone->second;
 
-	const auto& start = nodeAnim->mScalingKeys[index].mValue;
-	const auto& end = nodeAnim->mScalingKeys[nextIndex].mValue;
-	auto delta = end - start;
-	auto aiVec = start + factor * delta;
-	return { aiVec.x, aiVec.y, aiVec.z };
+	int32_t index = (int32_t)m_Nodes.size();
+	m_Nodes.push_back(animationNode);
+	nodeIndices.emplace(name, index);
+
+	for (uint32_t i = 0; i < node->mNumChildren; i++)
+		BuildNodeHierarchy(node->mChildren[i], index, nodeIndices);
 }
 
-void Mesh::ReadNodeHierarchy(float AnimationTime, const aiNode* pNode, const Matrix4x4& ParentTransform)
+int Mesh::GetClipCount() const
 {
-	std::string name(pNode->mName.data);
-	const aiAnimation* animation = m_Scene->mAnimations[0];
-	Matrix4x4 nodeTransform(aiMatrix4x4ToDSY(pNode->mTransformation));
-	const aiNodeAnim* nodeAnim = FindNodeAnim(animation, name);
-	
-	if (nodeAnim)
-	{
-		Vector3 translation = InterpolateTranslation(AnimationTime, nodeAnim);
-		Matrix4x4 translationMatrix = Matrix4x4::Translation(translation);
-	
-		Quaternion rotation = InterpolateRotation(AnimationTime, nodeAnim);
-		Matrix4x4 rotationMatrix = Matrix4x4(rotation);
+	return (int)m_Clips.size();
+}
 
-		Vector3 scale = InterpolateScale(AnimationTime, nodeAnim);
-		Matrix4x4 scaleMatrix = Matrix4x4::Scaling(scale);
+float Mesh::GetClipDuration(int clip) const
+{
+	return m_Clips[clip].GetDuration();
+}
 
-		nodeTransform = translationMatrix * rotationMatrix * scaleMatrix;
-	}
+size_t Mesh::GetClipMemoryUsage() const
+{
+	size_t bytes = 0;
 
-	Matrix4x4 transform = ParentTransform * nodeTransform;
+	for (const AnimationClip& clip : m_Clips)
+		bytes += clip.GetMemoryUsage();
 
-	if (m_BoneMapping.find(name) != m_BoneMapping.end())
-	{
-		uint32_t BoneIndex = m_BoneMapping[name];
-		m_BoneInfo[BoneIndex].FinalTransformation = m_InverseTransform * transform * m_BoneInfo[BoneIndex].BoneOffset;
-	}
+	return bytes;
+}
 
-	for (uint32_t i = 0; i < pNode->mNumChildren; i++)
-		ReadNodeHierarchy(AnimationTime, pNode->mChildren[i], transform);
+void Mesh::InitializePose(AnimationPose& pose) const
+{
+	pose.cursors.assign(m_Nodes.size(), KeyCursor());
+	pose.globalTransforms.resize(m_Nodes.size());
+	pose.boneTransforms.resize(m_BoneCount);
 }
 
-const aiNodeAnim* Mesh::FindNodeAnim(const aiAnimation* animation, const std::string& nodeName)
+void Mesh::EvaluatePose(int clip, float time, AnimationPose& pose) const
 {
-	for (uint32_t i = 0; i < animation->mNumChannels; i++)
+	const AnimationClip& animationClip = m_Clips[clip];
+	float ticks = time * animationClip.GetTicksPerSecond();
+
+	for (size_t i = 0; i < m_Nodes.size(); i++)
 	{
-		const aiNodeAnim* nodeAnim = animation->mChannels[i];
-		if (std::string(nodeAnim->mNodeName.data) == nodeName)
-			return nodeAnim;
+		const AnimationNode& node = m_Nodes[i];
+		Matrix4x4 nodeTransform = node.localTransform;
+
+		if (animationClip.HasChannel(i))
+		{
+			Vector3 translation, scale;
+			Quaternion rotation;
+			animationClip.Sample(i, ticks, pose.cursors[i], translation, rotation, scale);
+
+			nodeTransform = Matrix4x4::Translation(translation) * Matrix4x4(rotation) * Matrix4x4::Scaling(scale);
+		}
+
+		pose.globalTransforms[i] = node.parent < 0 ? nodeTransform : pose.globalTransforms[node.parent] * nodeTransform;
+
+		if (node.bone >= 0)
+			pose.boneTransforms[node.bone] = m_InverseTransform * pose.globalTransforms[i] * m_BoneInfo[node.bone].BoneOffset;
 	}
-	return nullptr;
 }
-
-void Mesh::BoneTransform(float time)
-{
-	ReadNodeHierarchy(time, m_Scene->mRootNode, Matrix4x4());
-	m_BoneTransforms.resize(m_BoneCount);
-	for (size_t i = 0; i < m_BoneCount; i++)
-		m_BoneTransforms[i] = m_BoneInfo[i].FinalTransformation;
-}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <unordered_map>
 
 #include <assimp/Importer.hpp>
@@ -16,6 +17,13 @@
 #include "../Core/Math/Quaternion.hpp"
 
 #include "Shader.hpp"
+#include "Bounds.hpp"
+#include "BonePalette.hpp"
+#include "UBO.hpp"
+#include "AnimationClip.hpp"
+#include "../Core/MappedFile.hpp"
+
+static const int MAX_MESH_LODS = 4;
 
 struct Vertex
 {
@@ -51,6 +59,28 @@ struct AnimatedVertex
 	}
 };
 
+// GPU layouts used when Mesh::usePackedVertices is set, 24 and 32 bytes against 56 and 88 for the float layouts.
+// Normals and tangents are signed normalized 10_10_10_2 with the binormal's handedness in the tangent's w, so the binormal
+// attribute is not bound and shaders that need it use cross(normal, tangent.xyz) * tangent.w. Texcoords are half floats.
+struct PackedVertex
+{
+	Vector3 Position;
+	uint32_t Normal;
+	uint32_t Tangent;
+	uint16_t Texcoord[2];
+};
+
+struct PackedAnimatedVertex
+{
+	Vector3 Position;
+	uint32_t Normal;
+	uint32_t Tangent;
+	uint16_t Texcoord[2];
+
+	uint8_t IDs[4];
+	uint8_t Weights[4];
+};
+
 struct Triangle
 {
 	uint32_t v1, v2, v3;
@@ -59,7 +89,6 @@ struct Triangle
 struct BoneInfo
 {
 	Matrix4x4 BoneOffset;
-	Matrix4x4 FinalTransformation;
 };
 
 struct VertexBoneData
@@ -87,6 +116,22 @@ struct VertexBoneData
 	}
 };
 
+// A node of the scene hierarchy flattened for evaluation. The bone index is bound once at load.
+struct AnimationNode
+{
+	int32_t parent;
+	int32_t bone;
+	Matrix4x4 localTransform;
+};
+
+// Evaluation state of one animated instance, sized by Mesh::InitializePose and written by Mesh::EvaluatePose
+struct AnimationPose
+{
+	std::vector<KeyCursor> cursors;
+	std::vector<Matrix4x4> globalTransforms;
+	std::vector<Matrix4x4> boneTransforms;
+};
+
 class Submesh
 {
 public:
@@ -95,48 +140,97 @@ public:
 	uint32_t MaterialIndex;
 	uint32_t IndexCount;
 
+	// Index range of each level of detail; level 0 is BaseIndex and IndexCount
+	uint32_t LodBaseIndex[MAX_MESH_LODS];
+	uint32_t LodIndexCount[MAX_MESH_LODS];
+
 	Matrix4x4 Transform;
 };
 
+// Geometry read by Mesh::LoadFromFile and waiting for Mesh::UploadToGPU, either inside a cooked file mapping or in vertexData
+struct MeshStaging
+{
+	std::unique_ptr<MappedFile> cookedFile;
+	std::vector<uint8_t> vertexData;
+	const void* vertices = nullptr;
+	size_t verticesSize = 0;
+	const void* indices = nullptr;
+	size_t indicesSize = 0;
+};
+
 class Mesh
 {
 public:
+	// An empty mesh draws nothing; ResourceManager hands these out while the real mesh loads and then moves it in
+	Mesh() {};
 	Mesh(const std::string& filename);
-	void Render();
+
+	// Loading is split so the file work can run off the GL thread: LoadFromFile makes no GL calls, UploadToGPU must run on the GL thread
+	bool LoadFromFile(const std::string& filename);
+	void UploadToGPU();
+	size_t GetStagedSize() const { return staging.verticesSize + staging.indicesSize; }
+	bool IsLoaded() const { return loaded; }
+
+	void Render(int lod = 0);
+	void RenderInstanced(int instanceCount, int lod = 0);
+	bool IsAnimated() const { return m_IsAnimated; }
+	const Bounds& GetBounds() const { return bounds; }
+
+	// screenSize is the bounding radius over the half height of the view at the mesh's distance.
+	// Pass the level chosen last frame, or -1, so that meshes near a threshold do not switch every frame.
+	int SelectLod(float screenSize, int previousLod) const;
+	int GetLodCount() const { return lodCount; }
+	uint32_t GetIndexCount(int lod) const { return lodIndexCounts[lod]; }
+
+	// Average vertices transformed per triangle of level 0, as imported and after OptimizeVertexOrder
+	float GetUnoptimizedACMR() const { return unoptimizedACMR; }
+	float GetVertexCacheACMR() const { return vertexCacheACMR; }
+
+	// Layout used by meshes loaded from now on
+	static bool usePackedVertices;
 private:
-	std::unique_ptr<Assimp::Importer> importer;
+	bool LoadCooked(const std::string& cookedPath, uint64_t cookKey);
+	void WriteCooked(const std::string& cookedPath, uint64_t cookKey, const std::vector<uint8_t>& vertexData) const;
+	bool Import(const std::string& filename, std::vector<uint8_t>& vertexData);
+	void Upload(const void* vertexData, size_t vertexDataSize, const void* indexData, size_t indexDataSize);
+	void CalculateBounds();
+	template<typename VertexType> void WeldVertices(std::vector<VertexType>& vertexData);
+	template<typename VertexType> void OptimizeVertexOrder(std::vector<VertexType>& vertexData);
+	void GenerateLods();
+	Bounds bounds;
 	std::vector<Submesh> submeshes;
 	std::vector<Vertex> vertices;
 	std::vector<Triangle> triangles;
-	const aiScene* m_Scene;
 	std::string m_FilePath;
 	uint32_t vertexArrayObjectID = -1;
+	MeshStaging staging;
+	bool loaded = false;
+	int lodCount = 1;
+	uint32_t lodIndexCounts[MAX_MESH_LODS] = {};
+	float unoptimizedACMR = 0.0f;
+	float vertexCacheACMR = 0.0f;
 
 
 
 public:
-	void Render(std::shared_ptr<Shader> shader, float deltaTime);
+	// Animation data is shared by every instance of the mesh; per instance state lives in AnimationPose
+	int GetClipCount() const;
+	float GetClipDuration(int clip) const;
+	size_t GetClipMemoryUsage() const;
+	void InitializePose(AnimationPose& pose) const;
+	void EvaluatePose(int clip, float time, AnimationPose& pose) const;
+	const UBO& GetRestPose() const { return m_RestPoseUBO; }
 private:
-	void BoneTransform(float time);
-	void ReadNodeHierarchy(float AnimationTime, const aiNode* pNode, const Matrix4x4& ParentTransform);
+	void BuildNodeHierarchy(const aiNode* node, int32_t parent, std::unordered_map<std::string, int32_t>& nodeIndices);
 	void TraverseNodes(aiNode* node, int level = 0);
-	const aiNodeAnim* FindNodeAnim(const aiAnimation* animation, const std::string& nodeName);
-	uint32_t FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim);
-	uint32_t FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim);
-	uint32_t FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim);
-	Vector3 InterpolateTranslation(float animationTime, const aiNodeAnim* nodeAnim);
-	Quaternion InterpolateRotation(float animationTime, const aiNodeAnim* nodeAnim);
-	Vector3 InterpolateScale(float animationTime, const aiNodeAnim* nodeAnim);
 private:
 	Matrix4x4 m_InverseTransform;
 	uint32_t m_BoneCount = 0;
 	std::vector<BoneInfo> m_BoneInfo;
 	std::vector<AnimatedVertex> m_AnimatedVertices;
 	std::unordered_map<std::string, uint32_t> m_BoneMapping;
-	std::vector<Matrix4x4> m_BoneTransforms;
+	std::vector<AnimationNode> m_Nodes;
+	std::vector<AnimationClip> m_Clips;
+	UBO m_RestPoseUBO;
 	bool m_IsAnimated = false;
-	float m_AnimationTime = 0.0f;
-	float m_WorldTime = 0.0f;
-	float m_TimeMultiplier = 1.0f;
-	bool m_AnimationPlaying = true;
 };
\ No newline at end of file
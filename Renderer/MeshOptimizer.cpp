@@ -0,0 +1,202 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const int kCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+static float VertexScore(int cachePosition, uint32_t liveTriangles)
+{
+	if (liveTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// The three vertices of the last triangle get a fixed score so the next triangle is not biased towards one edge
+		if (cachePosition < 3)
+			score = kLastTriangleScore;
+		else
+			score = powf(1.0f - (float)(cachePosition - 3) / (float)(kCacheSize - 3), kCacheDecayPower);
+	}
+
+	// Vertices with few triangles left are finished first so they do not have to come back into the cache later
+	score += kValenceBoostScale * powf((float)liveTriangles, -kValenceBoostPower);
+	return score;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	if (triangleCount < 2)
+		return;
+
+	// Triangles adjacent to each vertex, packed into one array
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+
+	for (uint32_t index : indices)
+		liveTriangles[index]++;
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> adjacencyCounts(vertexCount, 0);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			uint32_t v = indices[t * 3 + c];
+			adjacency[adjacencyOffsets[v] + adjacencyCounts[v]++] = (uint32_t)t;
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScores[v] = VertexScore(-1, liveTriangles[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	uint32_t cache[kCacheSize + 3];
+	int cacheCount = 0;
+
+	int bestTriangle = (int)(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+	size_t nextUnemitted = 0;
+
+	while (bestTriangle >= 0)
+	{
+		emitted[bestTriangle] = true;
+
+		uint32_t corners[3] = { indices[bestTriangle * 3], indices[bestTriangle * 3 + 1], indices[bestTriangle * 3 + 2] };
+		result.insert(result.end(), corners, corners + 3);
+
+		uint32_t newCache[kCacheSize + 3];
+		int newCacheCount = 0;
+
+		for (uint32_t v : corners)
+		{
+			// Drop the emitted triangle from the vertex's live list; degenerate triangles list a vertex more than once
+			uint32_t* begin = adjacency.data() + adjacencyOffsets[v];
+			uint32_t* end = begin + liveTriangles[v];
+			uint32_t* found = std::find(begin, end, (uint32_t)bestTriangle);
+
+			if (found == end)
+				continue;
+
+			std::swap(*found, *(end - 1));
+			liveTriangles[v]--;
+
+			newCache[newCacheCount++] = v;
+		}
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+				newCache[newCacheCount++] = v;
+		}
+
+		// Vertices pushed out of the cache lose their position score
+		for (int i = kCacheSize; i < newCacheCount; i++)
+			vertexScores[newCache[i]] = VertexScore(-1, liveTriangles[newCache[i]]);
+
+		cacheCount = std::min(newCacheCount, kCacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		for (int i = 0; i < cacheCount; i++)
+			vertexScores[cache[i]] = VertexScore(i, liveTriangles[cache[i]]);
+
+		// Only triangles touching the cache changed score, so the next triangle is searched among them
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (int i = 0; i < newCacheCount; i++)
+		{
+			uint32_t v = newCache[i];
+
+			for (uint32_t a = 0; a < liveTriangles[v]; a++)
+			{
+				uint32_t t = adjacency[adjacencyOffsets[v] + a];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = (int)t;
+				}
+			}
+		}
+
+		if (bestTriangle < 0)
+		{
+			while (nextUnemitted < triangleCount && emitted[nextUnemitted])
+				nextUnemitted++;
+
+			if (nextUnemitted < triangleCount)
+				bestTriangle = (int)nextUnemitted;
+		}
+	}
+
+	indices.swap(result);
+}
+
+std::vector<uint32_t> MeshOptimizer::BuildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const uint32_t unassigned = 0xFFFFFFFF;
+	std::vector<uint32_t> remap(vertexCount, unassigned);
+	uint32_t next = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (remap[index] == unassigned)
+			remap[index] = next++;
+	}
+
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == unassigned)
+			remap[v] = next++;
+	}
+
+	return remap;
+}
+
+float MeshOptimizer::CalculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize)
+{
+	if (indices.empty())
+		return 0.0f;
+
+	// Timestamps emulate a FIFO: a vertex hits if it entered the cache within the last cacheSize misses
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (insertedAt[index] == 0 || misses - insertedAt[index] + 1 > cacheSize)
+		{
+			misses++;
+			insertedAt[index] = misses;
+		}
+	}
+
+	return (float)misses / (float)(indices.size() / 3);
+}
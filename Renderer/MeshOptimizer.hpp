@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Load time reordering of index and vertex buffers so the GPU transforms and fetches each vertex as few times as possible
+class MeshOptimizer
+{
+public:
+	// Reorders triangles so that consecutive ones share vertices still in the post-transform cache (Forsyth's linear speed method)
+	static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	// Returns the new position of every vertex when ordered by first use in indices; unreferenced vertices go last
+	static std::vector<uint32_t> BuildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+	// Average number of vertices transformed per triangle with a FIFO cache of the given size
+	static float CalculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize = 16);
+};
@@ -11,6 +11,7 @@ struct MeshRenderer
 	MeshRenderer(std::string materialPath, std::string meshPath, bool castsShadows)
 	{
 		material = ResourceManager::GetInstance()->GetMaterial(materialPath);
+		ResourceManager::GetInstance()->LoadMeshAsync(meshPath);
 		mesh = ResourceManager::GetInstance()->GetMesh(meshPath);
 		this->castsShadows = castsShadows;
 	};
@@ -18,6 +19,7 @@ struct MeshRenderer
 	MeshRenderer(std::string materialPath, std::string meshPath)
 	{
 		material = ResourceManager::GetInstance()->GetMaterial(materialPath);
+		ResourceManager::GetInstance()->LoadMeshAsync(meshPath);
 		mesh = ResourceManager::GetInstance()->GetMesh(meshPath);
 		castsShadows = true;
 	};
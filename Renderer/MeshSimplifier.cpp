@@ -0,0 +1,276 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+// Symmetric 4x4 quadric stored as its 10 unique coefficients
+struct Quadric
+{
+	double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+	void AddPlane(double a, double b, double c, double d)
+	{
+		a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+		b2 += b * b; bc += b * c; bd += b * d;
+		c2 += c * c; cd += c * d;
+		d2 += d * d;
+	}
+
+	void Add(const Quadric& other)
+	{
+		a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+		b2 += other.b2; bc += other.bc; bd += other.bd;
+		c2 += other.c2; cd += other.cd;
+		d2 += other.d2;
+	}
+
+	double Evaluate(const Vector3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			+ c2 * z * z + 2 * cd * z
+			+ d2;
+	}
+};
+
+struct Collapse
+{
+	double cost;
+	uint32_t from;
+	uint32_t to;
+
+	bool operator > (const Collapse& other) const { return cost > other.cost; }
+};
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const Vector3* positions, size_t vertexCount, const std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	// Vertices are welded by exact position, so topology is evaluated per position rather than per vertex
+	std::vector<uint32_t> group(vertexCount);
+	std::vector<uint32_t> groupVertexCount;
+	{
+		struct PositionHash { size_t operator()(const Vector3& p) const { uint32_t h[3]; memcpy(h, &p.x, sizeof(h)); return h[0] * 73856093u ^ h[1] * 19349663u ^ h[2] * 83492791u; } };
+		struct PositionEqual { bool operator()(const Vector3& a, const Vector3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; } };
+		std::unordered_map<Vector3, uint32_t, PositionHash, PositionEqual> groups;
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			auto inserted = groups.emplace(positions[v], (uint32_t)groupVertexCount.size());
+
+			if (inserted.second)
+				groupVertexCount.push_back(0);
+
+			group[v] = inserted.first->second;
+		}
+	}
+
+	std::vector<bool> used(vertexCount, false);
+
+	for (uint32_t index : indices)
+	{
+		if (!used[index])
+		{
+			used[index] = true;
+			groupVertexCount[group[index]]++;
+		}
+	}
+
+	// Borders are edges with a single triangle; seams are positions shared by several vertices
+	std::vector<bool> locked(groupVertexCount.size(), false);
+	{
+		std::unordered_map<uint64_t, int> edgeUse;
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int e = 0; e < 3; e++)
+				edgeUse[EdgeKey(group[indices[t * 3 + e]], group[indices[t * 3 + (e + 1) % 3]])]++;
+		}
+
+		for (auto& edge : edgeUse)
+		{
+			if (edge.second == 1)
+			{
+				locked[(uint32_t)(edge.first >> 32)] = true;
+				locked[(uint32_t)(edge.first & 0xFFFFFFFF)] = true;
+			}
+		}
+
+		for (size_t g = 0; g < groupVertexCount.size(); g++)
+		{
+			if (groupVertexCount[g] > 1)
+				locked[g] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(groupVertexCount.size());
+	Vector3 boundsMin = positions[indices.empty() ? 0 : indices[0]];
+	Vector3 boundsMax = boundsMin;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const Vector3& p0 = positions[indices[t * 3]];
+		const Vector3& p1 = positions[indices[t * 3 + 1]];
+		const Vector3& p2 = positions[indices[t * 3 + 2]];
+
+		Vector3 normal = Vector3::Cross(p1 - p0, p2 - p0);
+		float length = normal.Length();
+
+		if (length > 0.0f)
+		{
+			normal /= length;
+
+			for (int c = 0; c < 3; c++)
+				quadrics[group[indices[t * 3 + c]]].AddPlane(normal.x, normal.y, normal.z, -Vector3::Dot(normal, p0));
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			boundsMin = Vector3::Min(boundsMin, positions[indices[t * 3 + c]]);
+			boundsMax = Vector3::Max(boundsMax, positions[indices[t * 3 + c]]);
+		}
+	}
+
+	double errorLimit = (double)maxError * (double)(boundsMax - boundsMin).Length();
+	errorLimit *= errorLimit;
+
+	std::vector<uint32_t> triangles(indices);
+	std::vector<bool> triangleAlive(triangleCount, true);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	std::vector<bool> vertexAlive(vertexCount, true);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+			vertexTriangles[triangles[t * 3 + c]].push_back((uint32_t)t);
+	}
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	auto pushEdges = [&](uint32_t t)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			uint32_t a = triangles[t * 3 + e];
+			uint32_t b = triangles[t * 3 + (e + 1) % 3];
+
+			if (!locked[group[a]])
+				queue.push({ quadrics[group[a]].Evaluate(positions[b]) + quadrics[group[b]].Evaluate(positions[b]), a, b });
+
+			if (!locked[group[b]])
+				queue.push({ quadrics[group[a]].Evaluate(positions[a]) + quadrics[group[b]].Evaluate(positions[a]), b, a });
+		}
+	};
+
+	for (size_t t = 0; t < triangleCount; t++)
+		pushEdges((uint32_t)t);
+
+	size_t aliveTriangles = triangleCount;
+
+	while (aliveTriangles * 3 > targetIndexCount && !queue.empty())
+	{
+		Collapse collapse = queue.top();
+		queue.pop();
+
+		uint32_t from = collapse.from;
+		uint32_t to = collapse.to;
+
+		if (!vertexAlive[from] || !vertexAlive[to])
+			continue;
+
+		// Costs go stale as quadrics merge; re-queue with the current cost instead of updating in place
+		double cost = quadrics[group[from]].Evaluate(positions[to]) + quadrics[group[to]].Evaluate(positions[to]);
+
+		if (cost > collapse.cost * 1.0001 + 1e-12)
+		{
+			queue.push({ cost, from, to });
+			continue;
+		}
+
+		if (cost > errorLimit)
+			break;
+
+		bool sharesTriangle = false;
+		bool flips = false;
+
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (!triangleAlive[t])
+				continue;
+
+			uint32_t* corners = &triangles[t * 3];
+
+			if (corners[0] == to || corners[1] == to || corners[2] == to)
+			{
+				sharesTriangle = true;
+				continue;
+			}
+
+			Vector3 before = Vector3::Cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+			Vector3 moved[3];
+
+			for (int c = 0; c < 3; c++)
+				moved[c] = positions[corners[c] == from ? to : corners[c]];
+
+			Vector3 after = Vector3::Cross(moved[1] - moved[0], moved[2] - moved[0]);
+
+			if (Vector3::Dot(before, after) <= 0.0f)
+			{
+				flips = true;
+				break;
+			}
+		}
+
+		if (!sharesTriangle || flips)
+			continue;
+
+		vertexAlive[from] = false;
+		quadrics[group[to]].Add(quadrics[group[from]]);
+
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (!triangleAlive[t])
+				continue;
+
+			uint32_t* corners = &triangles[t * 3];
+
+			for (int c = 0; c < 3; c++)
+			{
+				if (corners[c] == from)
+					corners[c] = to;
+			}
+
+			if (group[corners[0]] == group[corners[1]] || group[corners[1]] == group[corners[2]] || group[corners[0]] == group[corners[2]])
+			{
+				triangleAlive[t] = false;
+				aliveTriangles--;
+				continue;
+			}
+
+			vertexTriangles[to].push_back(t);
+			pushEdges(t);
+		}
+
+		vertexTriangles[from].clear();
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(aliveTriangles * 3);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (triangleAlive[t])
+			result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+	}
+
+	return result;
+}
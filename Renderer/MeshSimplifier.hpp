@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "../Core/Math/Vector3.hpp"
+
+// Quadric error metric simplification by half-edge collapse. A vertex is only ever merged into one of its neighbours,
+// so every level of detail indexes the original vertex buffer. Vertices on open borders and on attribute seams
+// (several vertices sharing a position) are never removed.
+class MeshSimplifier
+{
+public:
+	// Returns at most targetIndexCount indices, or fewer collapses if stopping early would exceed maxError,
+	// given as a distance relative to the size of the mesh.
+	static std::vector<uint32_t> Simplify(const Vector3* positions, size_t vertexCount, const std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError);
+};
@@ -0,0 +1,227 @@
+#include "RenderBenchmark.hpp"
+
+#include "RenderSystem.hpp"
+#include "LightSettings.hpp"
+#include "AnimationSystem.hpp"
+#include "TextureStreamer.hpp"
+#include "Camera.hpp"
+#include "Window.hpp"
+#include "../Core/Transform.hpp"
+#include "../Core/ResourceManager.hpp"
+#include "../Core/BinaryStream.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+// Frames are stepped as if running at 60 fps, however long they really take
+static const float s_FixedDeltaTime = 1.0f / 60.0f;
+// Loads still pending after this long are left to finish during the timed frames
+static const float s_MaxWarmupSeconds = 60.0f;
+
+RenderBenchmark::RenderBenchmark(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderSystem, std::shared_ptr<AnimationSystem> animationSystem, const RenderBenchmarkSettings& settings) :
+	registry(registry), renderSystem(renderSystem), animationSystem(animationSystem), settings(settings)
+{
+	renderTexture = std::make_shared<Texture>((float)settings.width, (float)settings.height, GL_RGB32F, GL_RGB);
+}
+
+bool RenderBenchmark::FindCamera(std::shared_ptr<Transform>& cameraTransform, std::shared_ptr<Camera>& camera)
+{
+	camera = nullptr;
+
+	registry->view<Transform, Camera>().each([&cameraTransform, &camera](auto& transform, auto& cam)
+	{
+		cameraTransform = std::make_shared<Transform>(transform);
+		camera = std::make_shared<Camera>(cam);
+	});
+
+	if (camera == nullptr)
+	{
+		std::cout << "Benchmark scene has no camera" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool RenderBenchmark::WarmUp()
+{
+	// Texture streaming only starts once a frame has asked for the textures, so frames are rendered until nothing is left to load
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int warmupFrames = 0;
+
+	do
+	{
+		ResourceManager::GetInstance()->Update();
+		TextureStreamer::GetInstance()->Update();
+
+		std::shared_ptr<Transform> cameraTransform;
+		std::shared_ptr<Camera> camera;
+
+		if (!FindCamera(cameraTransform, camera))
+			return false;
+
+		renderSystem->BeginFrame();
+		renderSystem->RenderAll(renderTexture, cameraTransform, camera);
+		glFinish();
+		warmupFrames++;
+
+		if (std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count() > s_MaxWarmupSeconds)
+		{
+			std::cout << "Benchmark starting with " << ResourceManager::GetInstance()->GetPendingLoadCount() << " resources and "
+				<< TextureStreamer::GetInstance()->GetPendingLoadCount() << " textures still loading" << std::endl;
+			return true;
+		}
+	} while (ResourceManager::GetInstance()->GetPendingLoadCount() > 0 || TextureStreamer::GetInstance()->GetPendingLoadCount() > 0);
+
+	std::cout << "Benchmark warmed up in " << warmupFrames << " frames" << std::endl;
+	return true;
+}
+
+bool RenderBenchmark::Run()
+{
+	frameTimes.clear();
+	frameTimes.reserve(settings.frames);
+	Window::GetInstance()->SetViewportDimensions((float)settings.width, (float)settings.height);
+	renderSystem->GetLightSettings()->SetCullOnCPU(settings.cpuLightCulling);
+	renderSystem->GetLightSettings()->SetVerifyCulling(settings.verifyLightCulling);
+
+	if (!WarmUp())
+		return false;
+
+	for (int frame = 0; frame < settings.frames; frame++)
+	{
+		std::chrono::high_resolution_clock::time_point updateStart = std::chrono::high_resolution_clock::now();
+
+		ResourceManager::GetInstance()->Update();
+		TextureStreamer::GetInstance()->Update();
+		animationSystem->Update(s_FixedDeltaTime);
+
+		std::shared_ptr<Transform> cameraTransform;
+		std::shared_ptr<Camera> camera;
+
+		if (!FindCamera(cameraTransform, camera))
+			return false;
+
+		std::chrono::high_resolution_clock::time_point renderStart = std::chrono::high_resolution_clock::now();
+
+		renderSystem->BeginFrame();
+		renderSystem->RenderAll(renderTexture, cameraTransform, camera);
+		glFinish();
+
+		std::chrono::high_resolution_clock::time_point renderEnd = std::chrono::high_resolution_clock::now();
+
+		const RenderStats& stats = renderSystem->GetStats();
+		FrameTimes times;
+		times.update = std::chrono::duration<float, std::milli>(renderStart - updateStart).count();
+		times.lights = stats.lightsMilliseconds;
+		times.shadows = stats.shadowsMilliseconds;
+		times.gather = stats.gatherMilliseconds;
+		times.draw = stats.drawMilliseconds;
+		times.overlay = stats.overlayMilliseconds;
+		times.frame = std::chrono::duration<float, std::milli>(renderEnd - renderStart).count();
+		frameTimes.push_back(times);
+
+		if (!settings.dumpFolder.empty() && settings.dumpInterval > 0 && frame % settings.dumpInterval == 0)
+			DumpFrame(frame);
+	}
+
+	WriteReport();
+	PrintSummary();
+
+	const LightSettings* lightSettings = renderSystem->GetLightSettings();
+
+	if (lightSettings->GetVerifyCulling() && !lightSettings->GetCullOnCPU())
+	{
+		std::cout << "Light culling: " << lightSettings->GetMismatchedFrames() << " of " << lightSettings->GetVerifiedFrames() << " frames differed between GPU and CPU" << std::endl;
+		return lightSettings->GetMismatchedFrames() == 0;
+	}
+
+	return true;
+}
+
+void RenderBenchmark::DumpFrame(int frame)
+{
+	int width = settings.width;
+	int height = settings.height;
+	std::vector<uint8_t> pixels((size_t)width * height * 3);
+
+	glBindTexture(GL_TEXTURE_2D, renderTexture->GetTextureID());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// Binary PPM, top row first, where GL returns the bottom row first
+	BinaryWriter writer;
+	std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+	writer.WriteBytes(header.data(), header.size());
+
+	for (int y = height - 1; y >= 0; y--)
+		writer.WriteBytes(pixels.data() + (size_t)y * width * 3, (size_t)width * 3);
+
+	char name[32];
+	snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+
+	if (!writer.WriteToFile(settings.dumpFolder + "/" + name))
+		std::cout << "Failed to write benchmark frame " << name << std::endl;
+}
+
+void RenderBenchmark::WriteReport() const
+{
+	if (settings.reportPath.empty())
+		return;
+
+	std::ofstream file(settings.reportPath, std::ios::trunc);
+
+	if (!file)
+	{
+		std::cout << "Failed to write benchmark report " << settings.reportPath << std::endl;
+		return;
+	}
+
+	file << "frame,update_ms,lights_ms,shadows_ms,gather_ms,draw_ms,overlay_ms,frame_ms\n";
+
+	for (size_t i = 0; i < frameTimes.size(); i++)
+	{
+		const FrameTimes& times = frameTimes[i];
+		file << i << "," << times.update << "," << times.lights << "," << times.shadows << "," << times.gather << "," << times.draw << "," << times.overlay << "," << times.frame << "\n";
+	}
+}
+
+void RenderBenchmark::PrintSummary() const
+{
+	if (frameTimes.empty())
+		return;
+
+	auto printColumn = [this](const char* name, float FrameTimes::* column)
+	{
+		std::vector<float> values;
+		values.reserve(frameTimes.size());
+
+		for (const FrameTimes& times : frameTimes)
+			values.push_back(times.*column);
+
+		std::sort(values.begin(), values.end());
+
+		float total = 0.0f;
+
+		for (float value : values)
+			total += value;
+
+		size_t p95 = std::min(values.size() - 1, (values.size() * 95) / 100);
+		printf("%-8s avg %8.3f  min %8.3f  max %8.3f  p95 %8.3f ms\n", name, total / values.size(), values.front(), values.back(), values[p95]);
+	};
+
+	std::cout << "Benchmark: " << frameTimes.size() << " frames at " << settings.width << "x" << settings.height << std::endl;
+	printColumn("update", &FrameTimes::update);
+	printColumn("lights", &FrameTimes::lights);
+	printColumn("shadows", &FrameTimes::shadows);
+	printColumn("gather", &FrameTimes::gather);
+	printColumn("draw", &FrameTimes::draw);
+	printColumn("overlay", &FrameTimes::overlay);
+	printColumn("frame", &FrameTimes::frame);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../Vendor/entt/entt.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class RenderSystem;
+class AnimationSystem;
+class Texture;
+struct Transform;
+struct Camera;
+
+struct RenderBenchmarkSettings
+{
+	int frames = 300;
+	int width = 1280;
+	int height = 720;
+
+	// Every dumpInterval frames is written to dumpFolder as a PPM image for comparison between runs; empty writes none
+	std::string dumpFolder;
+	int dumpInterval = 1;
+
+	std::string reportPath = "benchmark.csv";
+
+	// Culls lights with LightCuller instead of the compute passes, or checks the compute passes against it every frame
+	bool cpuLightCulling = false;
+	bool verifyLightCulling = false;
+};
+
+// Renders a scene offscreen for a fixed number of frames with a fixed time step, so runs are comparable,
+// and reports the CPU time of each render pass per frame
+class RenderBenchmark
+{
+public:
+	RenderBenchmark(std::shared_ptr<entt::registry> registry, std::shared_ptr<RenderSystem> renderSystem, std::shared_ptr<AnimationSystem> animationSystem, const RenderBenchmarkSettings& settings);
+
+	// Returns false if the scene has no camera to render from, or light culling was verified and the GPU and CPU disagreed
+	bool Run();
+private:
+	struct FrameTimes
+	{
+		float update;
+		float lights;
+		float shadows;
+		float gather;
+		float draw;
+		float overlay;
+		// RenderAll and waiting for the GPU to finish it
+		float frame;
+	};
+
+	bool FindCamera(std::shared_ptr<Transform>& cameraTransform, std::shared_ptr<Camera>& camera);
+	// Renders untimed frames until every mesh and texture load has finished, so frame 0 sees the whole scene
+	bool WarmUp();
+	void DumpFrame(int frame);
+	void WriteReport() const;
+	void PrintSummary() const;
+
+	std::shared_ptr<entt::registry> registry;
+	std::shared_ptr<RenderSystem> renderSystem;
+	std::shared_ptr<AnimationSystem> animationSystem;
+	RenderBenchmarkSettings settings;
+
+	std::shared_ptr<Texture> renderTexture;
+	std::vector<FrameTimes> frameTimes;
+};
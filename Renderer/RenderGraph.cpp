@@ -0,0 +1,411 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+// Pooled targets and framebuffers not used for this many frames are deleted, e.g. after a view is resized
+static const uint32_t s_FramesBeforeEviction = 60;
+
+static bool SameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b)
+{
+	return a.width == b.width && a.height == b.height && a.internalFormat == b.internalFormat;
+}
+
+template<typename T>
+static bool Contains(const std::vector<T>& values, T value)
+{
+	return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+RenderGraphPass& RenderGraphPass::Read(RenderResource resource)
+{
+	if (!Contains(reads, resource))
+		reads.push_back(resource);
+
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::Write(RenderResource resource)
+{
+	if (!Contains(writes, resource))
+		writes.push_back(resource);
+
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::SetColorAttachment(RenderResource resource)
+{
+	colorAttachment = resource;
+	return Write(resource);
+}
+
+RenderGraphPass& RenderGraphPass::SetDepthAttachment(RenderResource resource)
+{
+	depthAttachment = resource;
+	return Write(resource);
+}
+
+void RenderGraph::Reset()
+{
+	for (Resource& resource : resources)
+	{
+		if (!resource.imported && resource.acquired)
+		{
+			resource.isOutput = false;
+			ReleaseTransient(resource);
+		}
+	}
+
+	passes.clear();
+	resources.clear();
+	executionOrder.clear();
+}
+
+RenderResource RenderGraph::AddResource(const std::string& name, ResourceType type, bool imported)
+{
+	Resource resource;
+	resource.name = name;
+	resource.type = type;
+	resource.imported = imported;
+	resources.push_back(resource);
+	return (RenderResource)resources.size() - 1;
+}
+
+RenderResource RenderGraph::ImportTexture(const std::string& name, Texture* texture)
+{
+	RenderResource handle = AddResource(name, ResourceType::Texture, true);
+	resources[handle].texture = texture;
+	return handle;
+}
+
+RenderResource RenderGraph::ImportBuffer(const std::string& name)
+{
+	return AddResource(name, ResourceType::Buffer, true);
+}
+
+RenderResource RenderGraph::CreateRenderbuffer(const std::string& name, const RenderTargetDesc& desc)
+{
+	RenderResource handle = AddResource(name, ResourceType::Renderbuffer, false);
+	resources[handle].desc = desc;
+	return handle;
+}
+
+void RenderGraph::SetOutput(RenderResource resource)
+{
+	resources[resource].isOutput = true;
+}
+
+RenderGraphPass& RenderGraph::AddPass(const std::string& name, std::function<void()> execute)
+{
+	passes.emplace_back();
+	RenderGraphPass& pass = passes.back();
+	pass.name = name;
+	pass.execute = execute;
+	return pass;
+}
+
+bool RenderGraph::Schedule()
+{
+	size_t passCount = passes.size();
+	std::vector<std::vector<int>> dependents(passCount);
+	std::vector<int> dependencyCount(passCount, 0);
+
+	auto addDependency = [&dependents, &dependencyCount](int before, int after)
+	{
+		if (before != after && !Contains(dependents[before], after))
+		{
+			dependents[before].push_back(after);
+			dependencyCount[after]++;
+		}
+	};
+
+	for (RenderResource resource = 0; resource < (RenderResource)resources.size(); resource++)
+	{
+		int lastWriter = -1;
+
+		for (int i = 0; i < (int)passCount; i++)
+		{
+			if (!Contains(passes[i].writes, resource))
+				continue;
+
+			if (lastWriter >= 0)
+				addDependency(lastWriter, i);
+
+			lastWriter = i;
+		}
+
+		for (int i = 0; i < (int)passCount; i++)
+		{
+			if (!Contains(passes[i].reads, resource) || Contains(passes[i].writes, resource))
+				continue;
+
+			for (int writer = 0; writer < (int)passCount; writer++)
+			{
+				if (Contains(passes[writer].writes, resource))
+					addDependency(writer, i);
+			}
+		}
+	}
+
+	// Of the passes that are ready, the one added first goes next, so independent passes keep the order they were added in
+	executionOrder.clear();
+	std::vector<bool> scheduled(passCount, false);
+
+	while (executionOrder.size() < passCount)
+	{
+		int next = -1;
+
+		for (int i = 0; i < (int)passCount && next < 0; i++)
+		{
+			if (!scheduled[i] && dependencyCount[i] == 0)
+				next = i;
+		}
+
+		if (next < 0)
+		{
+			std::cout << "Render graph has a cycle; running passes in the order they were added" << std::endl;
+			executionOrder.clear();
+
+			for (int i = 0; i < (int)passCount; i++)
+				executionOrder.push_back(i);
+
+			return false;
+		}
+
+		scheduled[next] = true;
+		executionOrder.push_back(next);
+
+		for (int dependent : dependents[next])
+			dependencyCount[dependent]--;
+	}
+
+	return true;
+}
+
+void RenderGraph::Cull()
+{
+	std::vector<bool> needed(resources.size(), false);
+
+	for (size_t i = 0; i < resources.size(); i++)
+		needed[i] = resources[i].isOutput;
+
+	// Walking back from the end, a pass is kept if a kept pass or an output needs something it writes
+	for (auto it = executionOrder.rbegin(); it != executionOrder.rend(); ++it)
+	{
+		RenderGraphPass& pass = passes[*it];
+		pass.culled = true;
+
+		for (RenderResource resource : pass.writes)
+		{
+			if (needed[resource])
+				pass.culled = false;
+		}
+
+		if (pass.culled)
+			continue;
+
+		for (RenderResource resource : pass.reads)
+			needed[resource] = true;
+	}
+}
+
+void RenderGraph::AcquireTransient(Resource& resource)
+{
+	// Only renderbuffers are created by the graph
+	PooledRenderbuffer* found = nullptr;
+
+	for (size_t i = 0; i < renderbufferPool.size() && found == nullptr; i++)
+	{
+		if (!renderbufferPool[i].inUse && SameDesc(renderbufferPool[i].desc, resource.desc))
+			found = &renderbufferPool[i];
+	}
+
+	if (found == nullptr)
+	{
+		PooledRenderbuffer pooled;
+		pooled.desc = resource.desc;
+		pooled.renderbuffer = std::make_unique<Renderbuffer>(resource.desc.internalFormat, resource.desc.width, resource.desc.height);
+		renderbufferPool.push_back(std::move(pooled));
+		found = &renderbufferPool.back();
+	}
+
+	found->inUse = true;
+	found->lastUsedFrame = frame;
+	resource.renderbuffer = found->renderbuffer.get();
+	resource.acquired = true;
+}
+
+void RenderGraph::ReleaseTransient(Resource& resource)
+{
+	// Outputs stay with the caller until the next Reset
+	if (resource.isOutput || !resource.acquired)
+		return;
+
+	// Pool entries move when others are evicted, so they are found again by the object they own
+	for (PooledRenderbuffer& pooled : renderbufferPool)
+	{
+		if (pooled.renderbuffer.get() == resource.renderbuffer)
+			pooled.inUse = false;
+	}
+
+	resource.acquired = false;
+	resource.renderbuffer = nullptr;
+}
+
+void RenderGraph::BindFramebuffer(const RenderGraphPass& pass)
+{
+	Resource* color = pass.colorAttachment >= 0 ? &resources[pass.colorAttachment] : nullptr;
+	Resource* depth = pass.depthAttachment >= 0 ? &resources[pass.depthAttachment] : nullptr;
+
+	auto getID = [](Resource* resource) -> GLuint
+	{
+		if (resource == nullptr)
+			return 0;
+
+		return resource->type == ResourceType::Texture ? resource->texture->GetTextureID() : resource->renderbuffer->GetBufferID();
+	};
+
+	GLuint colorID = getID(color);
+	GLuint depthID = getID(depth);
+	bool colorIsRenderbuffer = color != nullptr && color->type == ResourceType::Renderbuffer;
+	bool depthIsRenderbuffer = depth != nullptr && depth->type == ResourceType::Renderbuffer;
+
+	for (PooledFramebuffer& pooled : framebufferPool)
+	{
+		if (pooled.colorID == colorID && pooled.depthID == depthID && pooled.colorIsRenderbuffer == colorIsRenderbuffer && pooled.depthIsRenderbuffer == depthIsRenderbuffer)
+		{
+			pooled.lastUsedFrame = frame;
+			pooled.framebuffer->Bind();
+			return;
+		}
+	}
+
+	PooledFramebuffer pooled;
+	pooled.colorID = colorID;
+	pooled.depthID = depthID;
+	pooled.colorIsRenderbuffer = colorIsRenderbuffer;
+	pooled.depthIsRenderbuffer = depthIsRenderbuffer;
+	pooled.framebuffer = std::make_unique<Framebuffer>();
+	pooled.lastUsedFrame = frame;
+
+	if (color != nullptr && colorIsRenderbuffer)
+		pooled.framebuffer->AttachRenderbuffer(*color->renderbuffer, GL_COLOR_ATTACHMENT0);
+	else if (color != nullptr)
+		pooled.framebuffer->AttachTexture(*color->texture, GL_COLOR_ATTACHMENT0);
+
+	if (depth != nullptr && depthIsRenderbuffer)
+		pooled.framebuffer->AttachRenderbuffer(*depth->renderbuffer, GL_DEPTH_ATTACHMENT);
+	else if (depth != nullptr)
+		pooled.framebuffer->AttachTexture(*depth->texture, GL_DEPTH_ATTACHMENT);
+
+	pooled.framebuffer->Bind();
+
+	if (color == nullptr)
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	framebufferPool.push_back(std::move(pooled));
+}
+
+void RenderGraph::Execute()
+{
+	frame++;
+	executedPassCount = 0;
+	culledPassCount = 0;
+
+	Schedule();
+	Cull();
+
+	for (int position = 0; position < (int)executionOrder.size(); position++)
+	{
+		const RenderGraphPass& pass = passes[executionOrder[position]];
+
+		if (pass.culled)
+			continue;
+
+		auto markUse = [this, position](RenderResource resource)
+		{
+			Resource& used = resources[resource];
+
+			if (used.firstUse < 0)
+				used.firstUse = position;
+
+			used.lastUse = position;
+		};
+
+		for (RenderResource resource : pass.reads)
+			markUse(resource);
+
+		for (RenderResource resource : pass.writes)
+			markUse(resource);
+	}
+
+	for (int position = 0; position < (int)executionOrder.size(); position++)
+	{
+		RenderGraphPass& pass = passes[executionOrder[position]];
+
+		if (pass.culled)
+		{
+			culledPassCount++;
+			continue;
+		}
+
+		for (Resource& resource : resources)
+		{
+			if (!resource.imported && resource.firstUse == position)
+				AcquireTransient(resource);
+		}
+
+		if (pass.colorAttachment >= 0 || pass.depthAttachment >= 0)
+			BindFramebuffer(pass);
+
+		pass.execute();
+		executedPassCount++;
+
+		for (Resource& resource : resources)
+		{
+			if (!resource.imported && resource.lastUse == position)
+				ReleaseTransient(resource);
+		}
+	}
+
+	Framebuffer::Unbind();
+	EvictUnused();
+}
+
+void RenderGraph::EvictUnused()
+{
+	std::vector<GLuint> evictedRenderbuffers;
+
+	for (auto it = renderbufferPool.begin(); it != renderbufferPool.end();)
+	{
+		if (!it->inUse && frame - it->lastUsedFrame > s_FramesBeforeEviction)
+		{
+			evictedRenderbuffers.push_back(it->renderbuffer->GetBufferID());
+			it = renderbufferPool.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	// A framebuffer goes with its attachments, since GL may hand their names out again
+	auto isEvicted = [&evictedRenderbuffers](GLuint id, bool isRenderbuffer)
+	{
+		return id != 0 && isRenderbuffer && Contains(evictedRenderbuffers, id);
+	};
+
+	for (auto it = framebufferPool.begin(); it != framebufferPool.end();)
+	{
+		bool stale = frame - it->lastUsedFrame > s_FramesBeforeEviction ||
+			isEvicted(it->colorID, it->colorIsRenderbuffer) || isEvicted(it->depthID, it->depthIsRenderbuffer);
+
+		if (stale)
+			it = framebufferPool.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Texture.hpp"
+#include "Renderbuffer.hpp"
+#include "Framebuffer.hpp"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+typedef int RenderResource;
+
+struct RenderTargetDesc
+{
+	int width;
+	int height;
+	GLenum internalFormat;
+};
+
+class RenderGraphPass
+{
+public:
+	RenderGraphPass& Read(RenderResource resource);
+	RenderGraphPass& Write(RenderResource resource);
+
+	// Attachments are written through a framebuffer the graph binds before the pass runs
+	RenderGraphPass& SetColorAttachment(RenderResource resource);
+	RenderGraphPass& SetDepthAttachment(RenderResource resource);
+private:
+	friend class RenderGraph;
+
+	std::string name;
+	std::function<void()> execute;
+	std::vector<RenderResource> reads;
+	std::vector<RenderResource> writes;
+	RenderResource colorAttachment = -1;
+	RenderResource depthAttachment = -1;
+	bool culled = false;
+};
+
+// Passes are declared each frame with the resources they read and write, then run in an order that satisfies them.
+// Passes whose results nothing uses are culled. Transient renderbuffers come from a pool kept across frames,
+// and a transient whose last reader has run goes back to the pool for later passes of the same frame.
+//
+// Passes writing the same resource run in the order they were added; passes that only read it run after all of them.
+class RenderGraph
+{
+public:
+	// Drops the passes and resources of the last frame; pooled targets and framebuffers are kept
+	void Reset();
+
+	// Imported resources are owned elsewhere. Buffers stand for GPU state the graph does not manage, such as
+	// the light grid, and only order the passes that use them.
+	RenderResource ImportTexture(const std::string& name, Texture* texture);
+	RenderResource ImportBuffer(const std::string& name);
+
+	RenderResource CreateRenderbuffer(const std::string& name, const RenderTargetDesc& desc);
+
+	// Outputs are what the frame is for; only passes leading to them are run
+	void SetOutput(RenderResource resource);
+
+	RenderGraphPass& AddPass(const std::string& name, std::function<void()> execute);
+	void Execute();
+
+	int GetExecutedPassCount() const { return executedPassCount; }
+	int GetCulledPassCount() const { return culledPassCount; }
+	int GetPooledTargetCount() const { return (int)renderbufferPool.size(); }
+private:
+	enum class ResourceType
+	{
+		Texture,
+		Renderbuffer,
+		Buffer
+	};
+
+	struct Resource
+	{
+		std::string name;
+		ResourceType type;
+		bool imported;
+		bool isOutput = false;
+		RenderTargetDesc desc;
+		Texture* texture = nullptr;
+		Renderbuffer* renderbuffer = nullptr;
+		bool acquired = false;
+		// Positions in the execution order of the first and last live passes using it
+		int firstUse = -1;
+		int lastUse = -1;
+	};
+
+	struct PooledRenderbuffer
+	{
+		RenderTargetDesc desc;
+		std::unique_ptr<Renderbuffer> renderbuffer;
+		bool inUse;
+		uint32_t lastUsedFrame;
+	};
+
+	struct PooledFramebuffer
+	{
+		GLuint colorID;
+		GLuint depthID;
+		bool colorIsRenderbuffer;
+		bool depthIsRenderbuffer;
+		std::unique_ptr<Framebuffer> framebuffer;
+		uint32_t lastUsedFrame;
+	};
+
+	RenderResource AddResource(const std::string& name, ResourceType type, bool imported);
+	bool Schedule();
+	void Cull();
+	void AcquireTransient(Resource& resource);
+	void ReleaseTransient(Resource& resource);
+	void BindFramebuffer(const RenderGraphPass& pass);
+	void EvictUnused();
+
+	std::deque<RenderGraphPass> passes;
+	std::vector<Resource> resources;
+	std::vector<int> executionOrder;
+
+	std::vector<PooledRenderbuffer> renderbufferPool;
+	std::vector<PooledFramebuffer> framebufferPool;
+	uint32_t frame = 0;
+
+	int executedPassCount = 0;
+	int culledPassCount = 0;
+};
@@ -0,0 +1,138 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+
+static const uint64_t kShaderBits = 10;
+static const uint64_t kMaterialBits = 15;
+static const uint64_t kMeshBits = 15;
+static const uint64_t kLodBits = 2;
+static const uint64_t kDepthBits = 22;
+
+// Every this many Clear calls, IDs not used since the last prune are freed
+static const uint32_t kPruneInterval = 300;
+
+static uint64_t Mask(uint64_t value, uint64_t bits)
+{
+	return value & ((1ull << bits) - 1);
+}
+
+void RenderQueue::Clear()
+{
+	items.clear();
+	generation++;
+
+	if (generation % kPruneInterval == 0)
+	{
+		Prune(shaderIDs);
+		Prune(materialIDs);
+		Prune(meshIDs);
+	}
+}
+
+uint32_t RenderQueue::GetID(IDTable& table, const void* pointer)
+{
+	// IDs are kept across frames so that the draw order of a static scene is stable
+	auto iterator = table.ids.find(pointer);
+
+	if (iterator != table.ids.end())
+	{
+		iterator->second.lastUsed = generation;
+		return iterator->second.id;
+	}
+
+	uint32_t id;
+
+	if (!table.freeIDs.empty())
+	{
+		id = table.freeIDs.back();
+		table.freeIDs.pop_back();
+	}
+	else
+	{
+		id = (uint32_t)(table.ids.size() + table.freeIDs.size());
+	}
+
+	table.ids.emplace(pointer, IDEntry{ id, generation });
+	return id;
+}
+
+void RenderQueue::Prune(IDTable& table)
+{
+	for (auto it = table.ids.begin(); it != table.ids.end();)
+	{
+		if (generation - it->second.lastUsed >= kPruneInterval)
+		{
+			table.freeIDs.push_back(it->second.id);
+			it = table.ids.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void RenderQueue::Submit(Shader* shader, Material* material, Mesh* mesh, int lod, const UBO* bonePalette, const Matrix4x4& model, float normalizedDepth)
+{
+	uint64_t shaderID = Mask(GetID(shaderIDs, shader), kShaderBits);
+	uint64_t materialID = Mask(GetID(materialIDs, material), kMaterialBits);
+	uint64_t meshID = Mask(GetID(meshIDs, mesh), kMeshBits);
+	uint64_t lodID = Mask((uint64_t)lod, kLodBits);
+
+	float clampedDepth = std::min(std::max(normalizedDepth, 0.0f), 1.0f);
+	uint64_t depth = (uint64_t)(clampedDepth * (float)((1ull << kDepthBits) - 1));
+
+	uint64_t key = shaderID << (kMaterialBits + kMeshBits + kLodBits + kDepthBits);
+	key |= materialID << (kMeshBits + kLodBits + kDepthBits);
+	key |= meshID << (kLodBits + kDepthBits);
+	key |= lodID << kDepthBits;
+	key |= depth;
+
+	DrawItem item;
+	item.sortKey = key;
+	item.shader = shader;
+	item.material = material;
+	item.mesh = mesh;
+	item.bonePalette = bonePalette;
+	item.lod = (uint8_t)lod;
+	item.model = model;
+	items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	// LSD radix sort over the 8 bytes of the key. Passes where every key shares the same byte are skipped,
+	// which is common for the upper bytes in small scenes.
+	size_t count = items.size();
+
+	if (count < 2)
+		return;
+
+	sortBuffer.resize(count);
+
+	for (int byte = 0; byte < 8; byte++)
+	{
+		int shift = byte * 8;
+		size_t histogram[256] = {};
+
+		for (size_t i = 0; i < count; i++)
+			histogram[(items[i].sortKey >> shift) & 0xFF]++;
+
+		if (histogram[(items[0].sortKey >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+
+		for (int i = 0; i < 256; i++)
+		{
+			size_t bucketSize = histogram[i];
+			histogram[i] = offset;
+			offset += bucketSize;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			sortBuffer[histogram[(items[i].sortKey >> shift) & 0xFF]++] = items[i];
+
+		items.swap(sortBuffer);
+	}
+}
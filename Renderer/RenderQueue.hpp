@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "../Core/Math/Matrix4x4.hpp"
+
+class Shader;
+class Material;
+class Mesh;
+class UBO;
+
+struct DrawItem
+{
+	uint64_t sortKey;
+	Shader* shader;
+	Material* material;
+	Mesh* mesh;
+	const UBO* bonePalette;
+	uint8_t lod;
+	Matrix4x4 model;
+};
+
+// Collects draws for a view and orders them by a 64 bit key so that consecutive draws share as much GPU state as possible.
+//
+// Key: | shader (10) | material (15) | mesh (15) | lod (2) | depth (22) |
+//
+// Only opaques go through the queue; they are grouped by state first and drawn front-to-back within a group.
+class RenderQueue
+{
+public:
+	void Clear();
+	void Submit(Shader* shader, Material* material, Mesh* mesh, int lod, const UBO* bonePalette, const Matrix4x4& model, float normalizedDepth);
+	void Sort();
+	const std::vector<DrawItem>& GetItems() const { return items; }
+	size_t Size() const { return items.size(); }
+private:
+	struct IDEntry
+	{
+		uint32_t id;
+		uint32_t lastUsed;
+	};
+
+	// IDs of objects not submitted for a while are dropped and handed out again, so the tables do not keep growing
+	// as objects are destroyed
+	struct IDTable
+	{
+		std::unordered_map<const void*, IDEntry> ids;
+		std::vector<uint32_t> freeIDs;
+	};
+
+	uint32_t GetID(IDTable& table, const void* pointer);
+	void Prune(IDTable& table);
+
+	std::vector<DrawItem> items;
+	std::vector<DrawItem> sortBuffer;
+
+	IDTable shaderIDs;
+	IDTable materialIDs;
+	IDTable meshIDs;
+	uint32_t generation = 0;
+};
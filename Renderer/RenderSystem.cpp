@@ -12,6 +12,23 @@
 #include "Material.hpp"
 #include "Window.hpp"
 #include "DirectionalLight.hpp"
+#include "AnimationSystem.hpp"
+#include "../Core/ThreadPool.hpp"
+
+#include <chrono>
+
+static const size_t kMeshesPerJob = 1024;
+// Frames, counted over every view, a render target can go unrendered before its level of detail history is dropped
+static const uint32_t kLodHistoryFrames = 120;
+
+// Time since the last lap, restarting the lap
+static float LapMilliseconds(std::chrono::high_resolution_clock::time_point& lapStart)
+{
+	std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+	float milliseconds = std::chrono::duration<float, std::milli>(now - lapStart).count();
+	lapStart = now;
+	return milliseconds;
+}
 
 RenderSystem::RenderSystem(std::shared_ptr<entt::registry> registry) : skybox ("Resources/PBR/Malibu_Overlook_3k.hdr"), registry(registry)
 {
@@ -21,7 +38,25 @@ RenderSystem::RenderSystem(std::shared_ptr<entt::registry> registry) : skybox ("
 	lightSettings = new LightSettings(registry);
 }
 
-void RenderSystem::RenderAll(std::shared_ptr<Texture> renderTexture, std::shared_ptr<Renderbuffer> depthBuffer, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera)
+void RenderSystem::BeginFrame()
+{
+	// Every count and timing starts from zero, so the views rendered this frame add up and passes they cull report nothing
+	lastFrameStats = stats;
+	stats = RenderStats();
+
+	std::chrono::high_resolution_clock::time_point lapStart = std::chrono::high_resolution_clock::now();
+	shadowSettings->Update();
+	stats.shadowsMilliseconds = LapMilliseconds(lapStart);
+	stats.shadowDraws = shadowSettings->shadowDraws;
+	stats.shadowDrawsSaved = shadowSettings->shadowDrawsSaved;
+	stats.shadowDrawCalls = shadowSettings->shadowDrawCalls;
+	stats.shadowMapsRendered = shadowSettings->shadowMapsRendered;
+	stats.shadowMapsCached = shadowSettings->shadowMapsCached;
+	stats.shadowAtlasSize = shadowSettings->shadowAtlas->GetSize();
+	stats.shadowAtlasUsedArea = shadowSettings->shadowAtlas->GetUsedArea();
+}
+
+void RenderSystem::RenderAll(std::shared_ptr<Texture> renderTexture, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera)
 {
 	Matrix4x4 projection = Matrix4x4::Perspective(camera->fov * kDegToRad, Window::GetInstance()->GetViewportWidth() / Window::GetInstance()->GetViewportHeight(), camera->nearPlane, camera->farPlane);
 
@@ -29,53 +64,97 @@ void RenderSystem::RenderAll(std::shared_ptr<Texture> renderTexture, std::shared
 	Vector3 forward = rotationMatrix * Vector3::forward;
 	Vector3 up = rotationMatrix * Vector3::up;
 	Matrix4x4 view = Matrix4x4::LookAt(cameraTransform->position, cameraTransform->position + forward, up);
+	frustum.Set(projection * view);
+	shadowSettings->AddView(cameraTransform->position, Window::GetInstance()->GetViewportHeight() / tanf(camera->fov * kDegToRad * 0.5f));
+
+	viewData.projection = projection;
+	viewData.view = view;
+	viewData.camPos = Vector4(cameraTransform->position.x, cameraTransform->position.y, cameraTransform->position.z, 1.0f);
+	viewData.nearPlane = camera->nearPlane;
+	viewData.farPlane = camera->farPlane;
+	viewData.screenWidth = Window::GetInstance()->GetViewportWidth();
+	viewData.screenHeight = Window::GetInstance()->GetViewportHeight();
+	viewData.clusterScreenSpaceSize = Vector2(
+		std::ceil((float)Window::GetInstance()->GetViewportWidth() / (float)lightSettings->GetClustersX()),
+		std::ceil((float)Window::GetInstance()->GetViewportHeight() / (float)lightSettings->GetClustersY()));
+	viewData.ambientLighting = 0.05f;
+	viewData.clusterCounts[0] = lightSettings->GetClustersX();
+	viewData.clusterCounts[1] = lightSettings->GetClustersY();
+	viewData.clusterCounts[2] = lightSettings->GetClustersZ();
+	viewDataUBO.Set(VIEW_DATA_BINDING, sizeof(ViewDataGLSL), &viewData);
 
-	lightSettings->Update(projection, view, camera->nearPlane, camera->farPlane);
-	shadowSettings->Update(camera, view);
-	
-	offscreenFramebuffer.Bind();
-	offscreenFramebuffer.AttachRenderbuffer(*depthBuffer, GL_DEPTH_ATTACHMENT);
-	offscreenFramebuffer.AttachTexture(*renderTexture, GL_COLOR_ATTACHMENT0);
+	std::chrono::high_resolution_clock::time_point lapStart = std::chrono::high_resolution_clock::now();
 
-	Window::GetInstance()->Clear();
+	GatherDraws(renderTexture.get(), forward, cameraTransform, camera);
+	renderQueue.Sort();
 
-	registry->view<Transform, MeshRenderer>().each([&projection, &view, &cameraTransform, &camera, this](auto& transform, auto& meshRenderer)
+	const std::vector<DrawItem>& items = renderQueue.GetItems();
+
+	// Every model matrix of the view goes up in one upload; item i reads slot i
+	instanceModels.clear();
+
+	for (const DrawItem& item : items)
+		instanceModels.push_back(item.model);
+
+	instanceBuffer.Upload(instanceModels);
+	stats.gatherMilliseconds += LapMilliseconds(lapStart);
+
+	renderGraph.Reset();
+
+	RenderTargetDesc depthDesc;
+	depthDesc.width = (int)viewData.screenWidth;
+	depthDesc.height = (int)viewData.screenHeight;
+	depthDesc.internalFormat = GL_DEPTH_COMPONENT24;
+
+	RenderResource colorTarget = renderGraph.ImportTexture("Camera Color", renderTexture.get());
+	RenderResource depthTarget = renderGraph.CreateRenderbuffer("Camera Depth", depthDesc);
+	RenderResource lightGrid = renderGraph.ImportBuffer("Light Grid");
+	renderGraph.SetOutput(colorTarget);
+
+	renderGraph.AddPass("Light Grid", [&]()
 	{
-		if (meshRenderer.material == nullptr || meshRenderer.mesh == nullptr)
-			return;
-
-		Matrix4x4 model = Matrix4x4::Transformation(transform);
-		std::shared_ptr<Shader> shader = meshRenderer.material->GetShader();
-
-		shader->Use();
-		shader->SetMatrix4x4("projection", projection);
-		shader->SetMatrix4x4("view", view);
-		shader->SetMatrix4x4("model", model);
-		shader->SetVector3("camPos", cameraTransform->position.x, cameraTransform->position.y, cameraTransform->position.z);
-		shader->SetFloat("nearPlane", camera->nearPlane);
-		shader->SetFloat("farPlane", camera->farPlane);
-		shader->SetFloat("screenWidth", Window::GetInstance()->GetViewportWidth());
-		shader->SetFloat("screenHeight", Window::GetInstance()->GetViewportHeight());
-		shader->SetFloat("ambientLighting", 0.05f);
-
-		shader->SetVector2("clusterScreenSpaceSize",
-			std::ceil((float)Window::GetInstance()->GetViewportWidth() / (float)8),
-			std::ceil((float)Window::GetInstance()->GetViewportHeight() / (float)8));
-
-		//pbrSettings.Bind(shader);
-		shadowSettings->shadowCubeMap->Bind(shader->GetTextureUnit("pointShadowMap"));
-		shadowSettings->shadowCubeMapArray->Bind(shader->GetTextureUnit("shadowCubeMapArray"));
-
-		meshRenderer.material->Bind();
-		meshRenderer.mesh->Render(shader, 0.01f);
-	});
+		lapStart = std::chrono::high_resolution_clock::now();
+		lightSettings->Update(projection, view, camera->nearPlane, camera->farPlane);
+		stats.lightsMilliseconds += LapMilliseconds(lapStart);
+	}).Write(lightGrid);
+
+	RenderGraphPass& opaquePass = renderGraph.AddPass("Opaque", [&]()
+	{
+		lapStart = std::chrono::high_resolution_clock::now();
+		Window::GetInstance()->Clear();
+		RenderOpaque(projection, view, cameraTransform, camera);
+		stats.drawMilliseconds += LapMilliseconds(lapStart);
+	}).SetColorAttachment(colorTarget).SetDepthAttachment(depthTarget);
 
-	skybox.Render(projection, view);
+	// With nothing to draw, the light grid pass has no reader and is culled
+	if (!items.empty())
+		opaquePass.Read(lightGrid);
 
-	registry->view<Transform, TextMesh>().each([](auto& transform, auto& textMesh)
+	renderGraph.AddPass("Skybox", [&]()
 	{
-		TextMesh::Render(textMesh, transform.position.x, transform.position.y);
-	});
+		lapStart = std::chrono::high_resolution_clock::now();
+		skybox.Render();
+		stats.overlayMilliseconds += LapMilliseconds(lapStart);
+	}).SetColorAttachment(colorTarget).SetDepthAttachment(depthTarget);
+
+	renderGraph.AddPass("Text", [&]()
+	{
+		lapStart = std::chrono::high_resolution_clock::now();
+
+		registry->view<Transform, TextMesh>().each([](auto& transform, auto& textMesh)
+		{
+			TextMesh::Render(textMesh, transform.position.x, transform.position.y);
+		});
+
+		stats.overlayMilliseconds += LapMilliseconds(lapStart);
+	}).SetColorAttachment(colorTarget).SetDepthAttachment(depthTarget);
+
+	renderGraph.Execute();
+
+	stats.renderPasses += renderGraph.GetExecutedPassCount();
+	stats.culledRenderPasses += renderGraph.GetCulledPassCount();
+	// The pool is shared by the views, so its size is not added up
+	stats.pooledRenderTargets = renderGraph.GetPooledTargetCount();
 
 	// TEMP
 	/*Transform t(Vector3::up * 8, Vector3::one, Quaternion::identity);
@@ -89,6 +168,221 @@ void RenderSystem::RenderAll(std::shared_ptr<Texture> renderTexture, std::shared
 	shadowSettings->shadowCubeMapArray->Bind(shader->GetTextureUnit("cubemapArray"));
 	std::shared_ptr<Mesh> mesh = ResourceManager::GetInstance()->GetMesh("Resources/Engine/Meshes/DefaultCube.obj");
 	mesh->Render();*/
+}
+
+void RenderSystem::GatherDraws(const Texture* renderTexture, const Vector3& forward, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera)
+{
+	renderQueue.Clear();
+
+	// Workers index the MeshRenderer pool directly and look transforms up through a view, which only reads the registry
+	auto meshRenderers = registry->view<MeshRenderer>();
+	auto transforms = registry->view<Transform>();
+	const entt::entity* entities = meshRenderers.data();
+	MeshRenderer* meshRendererData = meshRenderers.raw();
+	size_t meshCount = meshRenderers.size();
+
+	frame++;
+
+	for (auto it = selectedLods.begin(); it != selectedLods.end();)
+	{
+		if (it->first != renderTexture && frame - it->second.lastUsedFrame > kLodHistoryFrames)
+			it = selectedLods.erase(it);
+		else
+			++it;
+	}
+
+	LodHistory& history = selectedLods[renderTexture];
+	history.lastUsedFrame = frame;
+
+	// Sized for every entity up front, so each job only writes the slots of its own entities
+	std::vector<uint8_t>& previousLods = history.lods;
+
+	if (previousLods.size() < registry->size())
+		previousLods.resize(registry->size(), 0);
+
+	float tanHalfFov = tanf(camera->fov * kDegToRad * 0.5f);
+	float screenHeight = viewData.screenHeight;
+	gatherJobs.resize((meshCount + kMeshesPerJob - 1) / kMeshesPerJob);
 
-	Framebuffer::Unbind();
+	ThreadPool::ForEachChunk(meshCount, kMeshesPerJob, [&](size_t begin, size_t end)
+	{
+		GatherJob& job = gatherJobs[begin / kMeshesPerJob];
+		job.draws.clear();
+		job.textureRequests.clear();
+		job.visibleMeshes = 0;
+		job.culledMeshes = 0;
+		job.triangles = 0;
+		job.vertexCacheMisses = 0.0f;
+		job.unoptimizedVertexCacheMisses = 0.0f;
+		std::fill(job.meshesPerLod, job.meshesPerLod + MAX_MESH_LODS, 0);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			entt::entity entity = entities[i];
+			MeshRenderer& meshRenderer = meshRendererData[i];
+
+			if (meshRenderer.material == nullptr || meshRenderer.mesh == nullptr || !transforms.contains(entity))
+				continue;
+
+			Matrix4x4 model = Matrix4x4::Transformation(transforms.get(entity));
+			Bounds worldBounds = meshRenderer.mesh->GetBounds().Transformed(model);
+
+			if (!frustum.IsVisible(worldBounds))
+			{
+				job.culledMeshes++;
+				continue;
+			}
+
+			job.visibleMeshes++;
+
+			float viewDepth = Vector3::Dot(worldBounds.center - cameraTransform->position, forward);
+			float normalizedDepth = (viewDepth - camera->nearPlane) / (camera->farPlane - camera->nearPlane);
+
+			// Screen size is the fraction of the view height covered by the bounding sphere
+			float distance = std::max(Vector3::Distance(worldBounds.center, cameraTransform->position), camera->nearPlane);
+			float screenSize = worldBounds.radius / (distance * tanHalfFov);
+
+			size_t index = (size_t)entt::to_integral(registry->entity(entity));
+			int lod = meshRenderer.mesh->SelectLod(screenSize, previousLods[index]);
+			previousLods[index] = (uint8_t)lod;
+
+			// The streamer keeps the largest request of the frame per texture, so only each material's largest is passed on
+			float& requestedPixels = job.textureRequests[meshRenderer.material.get()];
+			requestedPixels = std::max(requestedPixels, screenSize * screenHeight);
+
+			job.meshesPerLod[lod]++;
+			int triangles = meshRenderer.mesh->GetIndexCount(lod) / 3;
+			job.triangles += triangles;
+			job.vertexCacheMisses += meshRenderer.mesh->GetVertexCacheACMR() * triangles;
+			job.unoptimizedVertexCacheMisses += meshRenderer.mesh->GetUnoptimizedACMR() * triangles;
+
+			GatheredDraw draw;
+			draw.material = meshRenderer.material.get();
+			draw.mesh = meshRenderer.mesh.get();
+			draw.lod = lod;
+			draw.entity = entity;
+			draw.model = model;
+			draw.normalizedDepth = normalizedDepth;
+			job.draws.push_back(draw);
+		}
+	});
+
+	// Jobs are merged in order, so the queue does not depend on how they were spread over threads. The sort key IDs,
+	// the texture streamer, the shaders' reference counts and the Animator lookup, which can create its pool, are only
+	// touched from this thread.
+	Material* shaderMaterial = nullptr;
+	Shader* shader = nullptr;
+
+	for (GatherJob& job : gatherJobs)
+	{
+		stats.visibleMeshes += job.visibleMeshes;
+		stats.culledMeshes += job.culledMeshes;
+		stats.triangles += job.triangles;
+		stats.vertexCacheMisses += job.vertexCacheMisses;
+		stats.unoptimizedVertexCacheMisses += job.unoptimizedVertexCacheMisses;
+
+		for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+			stats.meshesPerLod[lod] += job.meshesPerLod[lod];
+
+		for (const auto& request : job.textureRequests)
+			request.first->RequestTextureSize(request.second);
+
+		for (const GatheredDraw& draw : job.draws)
+		{
+			if (draw.material != shaderMaterial)
+			{
+				shaderMaterial = draw.material;
+				shader = draw.material->GetShader().get();
+			}
+
+			const UBO* bonePalette = AnimationSystem::GetBonePalette(*registry, draw.entity, draw.mesh);
+			renderQueue.Submit(shader, draw.material, draw.mesh, draw.lod, bonePalette, draw.model, draw.normalizedDepth);
+		}
+	}
 }
+
+void RenderSystem::RenderOpaque(const Matrix4x4& projection, const Matrix4x4& view, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera)
+{
+	const std::vector<DrawItem>& items = renderQueue.GetItems();
+	std::shared_ptr<Shader> shader;
+	Material* boundMaterial = nullptr;
+	int modelHandle = -1;
+	int instanceOffsetHandle = -1;
+
+	for (size_t batchStart = 0; batchStart < items.size();)
+	{
+		const DrawItem& item = items[batchStart];
+
+		// The sort key groups identical shader, material, mesh and level of detail, so a batch is a run of consecutive items
+		size_t batchEnd = batchStart + 1;
+
+		while (batchEnd < items.size() && items[batchEnd].shader == item.shader && items[batchEnd].material == item.material && items[batchEnd].mesh == item.mesh && items[batchEnd].lod == item.lod)
+			batchEnd++;
+
+		if (shader.get() != item.shader)
+		{
+			shader = item.material->GetShader();
+			boundMaterial = nullptr;
+			stats.shaderChanges++;
+
+			shader->Use();
+
+			// Shaders without the ViewData block still get the per-view values as plain uniforms
+			if (!shader->UsesViewData())
+			{
+				shader->SetMatrix4x4(shader->GetUniformHandle(EngineUniforms::projection), projection);
+				shader->SetMatrix4x4(shader->GetUniformHandle(EngineUniforms::view), view);
+				shader->SetVector3(shader->GetUniformHandle(EngineUniforms::camPos), cameraTransform->position.x, cameraTransform->position.y, cameraTransform->position.z);
+				shader->SetFloat(shader->GetUniformHandle(EngineUniforms::nearPlane), camera->nearPlane);
+				shader->SetFloat(shader->GetUniformHandle(EngineUniforms::farPlane), camera->farPlane);
+				shader->SetFloat(shader->GetUniformHandle(EngineUniforms::screenWidth), viewData.screenWidth);
+				shader->SetFloat(shader->GetUniformHandle(EngineUniforms::screenHeight), viewData.screenHeight);
+				shader->SetFloat(shader->GetUniformHandle(EngineUniforms::ambientLighting), viewData.ambientLighting);
+				shader->SetVector2(shader->GetUniformHandle(EngineUniforms::clusterScreenSpaceSize), viewData.clusterScreenSpaceSize.x, viewData.clusterScreenSpaceSize.y);
+			}
+
+			modelHandle = shader->GetUniformHandle(EngineUniforms::model);
+			instanceOffsetHandle = shader->GetUniformHandle(EngineUniforms::instanceOffset);
+
+			//pbrSettings.Bind(shader);
+			shadowSettings->shadowCubeMap->Bind(shader->GetTextureUnit(EngineUniforms::pointShadowMap));
+			shadowSettings->shadowAtlas->GetTexture().Bind(shader->GetTextureUnit(EngineUniforms::pointShadowAtlas));
+		}
+
+		if (boundMaterial != item.material)
+		{
+			boundMaterial = item.material;
+			boundMaterial->Bind();
+			stats.materialChanges++;
+		}
+
+		// Animated meshes carry a pose per entity, so they are still drawn one at a time
+		if (shader->UsesInstancing() && !item.mesh->IsAnimated())
+		{
+			shader->SetInt(instanceOffsetHandle, (int)batchStart);
+			item.mesh->RenderInstanced((int)(batchEnd - batchStart), item.lod);
+			stats.drawCalls++;
+
+			if (batchEnd - batchStart > 1)
+				stats.instancedBatches++;
+		}
+		else
+		{
+			for (size_t i = batchStart; i < batchEnd; i++)
+			{
+				if (shader->UsesInstancing())
+					shader->SetInt(instanceOffsetHandle, (int)i);
+				else
+					shader->SetMatrix4x4(modelHandle, items[i].model);
+
+				if (items[i].bonePalette)
+					items[i].bonePalette->Bind(BONE_PALETTE_BINDING);
+
+				items[i].mesh->Render(items[i].lod);
+				stats.drawCalls++;
+			}
+		}
+
+		batchStart = batchEnd;
+	}
+}
\ No newline at end of file
@@ -8,17 +8,113 @@
 #include "Skybox.hpp"
 #include "Framebuffer.hpp"
 #include "LightSettings.hpp"
+#include "Frustum.hpp"
+#include "RenderQueue.hpp"
+#include "ViewData.hpp"
+#include "UBO.hpp"
+#include "InstanceBuffer.hpp"
+#include "Mesh.hpp"
+#include "RenderGraph.hpp"
+
+struct RenderStats
+{
+	int visibleMeshes = 0;
+	int culledMeshes = 0;
+	int shaderChanges = 0;
+	int materialChanges = 0;
+	int drawCalls = 0;
+	int instancedBatches = 0;
+	int triangles = 0;
+	// Vertices transformed for the visible triangles, estimated from each mesh's level 0 ACMR
+	float vertexCacheMisses = 0.0f;
+	float unoptimizedVertexCacheMisses = 0.0f;
+	int meshesPerLod[MAX_MESH_LODS] = {};
+	int shadowDraws = 0;
+	int shadowDrawsSaved = 0;
+	int shadowDrawCalls = 0;
+	int shadowMapsRendered = 0;
+	int shadowMapsCached = 0;
+	int shadowAtlasSize = 0;
+	size_t shadowAtlasUsedArea = 0;
+
+	// CPU time spent issuing each part of the frame, over every view; the GPU can still be busy with it afterwards
+	float lightsMilliseconds = 0.0f;
+	float shadowsMilliseconds = 0.0f;
+	float gatherMilliseconds = 0.0f;
+	float drawMilliseconds = 0.0f;
+	float overlayMilliseconds = 0.0f;
+
+	int renderPasses = 0;
+	int culledRenderPasses = 0;
+	int pooledRenderTargets = 0;
+};
 
 class RenderSystem
 {
 public:
 	RenderSystem(std::shared_ptr<entt::registry> registry);
-	void RenderAll(std::shared_ptr<Texture> renderTexture, std::shared_ptr<Renderbuffer> depthBuffer, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera);
+	// Once per frame, before the views: renders the point light shadow maps every view of the frame shares and
+	// restarts the stats, which then add up over every view rendered until the next call
+	void BeginFrame();
+	// Depth and other intermediate targets are transient and come from the render graph's pool
+	void RenderAll(std::shared_ptr<Texture> renderTexture, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera);
+	// Stats of the frame in progress, complete once its last view has rendered
+	const RenderStats& GetStats() const { return stats; }
+	// Stats of the frame before, for code that runs between BeginFrame and the views
+	const RenderStats& GetLastFrameStats() const { return lastFrameStats; }
+	LightSettings* GetLightSettings() const { return lightSettings; }
 private:
+	// A visible mesh as recorded by a gather job, before it gets its sort key
+	struct GatheredDraw
+	{
+		Material* material;
+		Mesh* mesh;
+		int lod;
+		// The bone palette is looked up on the render thread, since finding the Animator can modify the registry
+		entt::entity entity;
+		Matrix4x4 model;
+		float normalizedDepth;
+	};
+
+	struct GatherJob
+	{
+		std::vector<GatheredDraw> draws;
+		std::unordered_map<Material*, float> textureRequests;
+		int visibleMeshes = 0;
+		int culledMeshes = 0;
+		int triangles = 0;
+		float vertexCacheMisses = 0.0f;
+		float unoptimizedVertexCacheMisses = 0.0f;
+		int meshesPerLod[MAX_MESH_LODS] = {};
+	};
+
+	// Culls and selects levels of detail for a chunk of meshes per job on the thread pool, then fills the render queue
+	void GatherDraws(const Texture* renderTexture, const Vector3& forward, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera);
+	void RenderOpaque(const Matrix4x4& projection, const Matrix4x4& view, std::shared_ptr<Transform> cameraTransform, std::shared_ptr<Camera> camera);
+
+	RenderStats stats;
+	RenderStats lastFrameStats;
+	Frustum frustum;
+	RenderQueue renderQueue;
+	ViewDataGLSL viewData;
+	UBO viewDataUBO;
+	InstanceBuffer instanceBuffer;
+	std::vector<Matrix4x4> instanceModels;
+	std::vector<GatherJob> gatherJobs;
+	// Level of detail each entity used last frame, per render target since every view selects its own.
+	// Targets not rendered for a while are dropped, so closed views do not keep their history.
+	struct LodHistory
+	{
+		std::vector<uint8_t> lods;
+		uint32_t lastUsedFrame;
+	};
+
+	std::unordered_map<const Texture*, LodHistory> selectedLods;
+	uint32_t frame = 0;
 	std::shared_ptr<entt::registry> registry;
 	ShadowSettings* shadowSettings;
 	LightSettings* lightSettings;
 	PBRSettings pbrSettings;
 	Skybox skybox;
-	Framebuffer offscreenFramebuffer;
+	RenderGraph renderGraph;
 };
\ No newline at end of file
@@ -33,6 +33,32 @@ public:
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	};
 
+	// Gives the buffer fresh storage without filling it, so nothing waits on draws still reading the old contents
+	void Orphan(int binding, size_t size)
+	{
+		if (initialized == false)
+		{
+			glGenBuffers(1, &ID);
+			initialized = true;
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ID);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+
+	template <class T>
+	void SetRange(size_t offset, size_t size, T* data)
+	{
+		if (size == 0)
+			return;
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+
 	template <class T>
 	void Get(size_t size, T* data)
 	{
@@ -1,8 +1,13 @@
 #include "Shader.hpp"
+#include "ViewData.hpp"
+#include "InstanceBuffer.hpp"
+#include "BonePalette.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <glad/glad.h>
+#include <cstring>
+#include <cassert>
 
 Shader::Shader(const std::string& shaderPath)
 {
@@ -80,11 +85,28 @@ void Shader::Compile(const std::string& vertexSource, const std::string& frageme
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 
+	unsigned int viewDataIndex = glGetUniformBlockIndex(shaderProgramID, VIEW_DATA_BLOCK_NAME);
+	usesViewData = viewDataIndex != GL_INVALID_INDEX;
+
+	if (usesViewData)
+		glUniformBlockBinding(shaderProgramID, viewDataIndex, VIEW_DATA_BINDING);
+
+	unsigned int bonePaletteIndex = glGetUniformBlockIndex(shaderProgramID, BONE_PALETTE_BLOCK_NAME);
+
+	if (bonePaletteIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(shaderProgramID, bonePaletteIndex, BONE_PALETTE_BINDING);
+
+	unsigned int instanceDataIndex = glGetProgramResourceIndex(shaderProgramID, GL_SHADER_STORAGE_BLOCK, INSTANCE_DATA_BLOCK_NAME);
+	usesInstancing = instanceDataIndex != GL_INVALID_INDEX;
+
+	ResolveActiveUniforms();
+
 	glUseProgram(shaderProgramID);
 
 	std::string uniformSamplerText = "uniform sampler";
 	size_t index = fragementSource.find(uniformSamplerText);
 	int textureUnitIndex = 0;
+	std::unordered_map<uint32_t, std::string> textureNames;
 
 	while (index != std::string::npos)
 	{
@@ -97,7 +119,7 @@ void Shader::Compile(const std::string& vertexSource, const std::string& frageme
 		std::string texName = fragementSource.substr(start, length);
 
 		glUniform1i(glGetUniformLocation(shaderProgramID, texName.c_str()), textureUnitIndex);
-		textureUnitMap.emplace(texName, textureUnitIndex);
+		AddHandle(textureUnitMap, textureNames, UniformName::Hash(texName.c_str()), texName.c_str(), textureUnitIndex);
 		textureUnitIndex++;
 
 		index = fragementSource.find(uniformSamplerText, index);
@@ -130,154 +152,172 @@ void Shader::CheckCompileErrors(unsigned int shader, std::string type)
 	}
 }
 
-void Shader::SetBool(std::string name, bool value)
+void Shader::ResolveActiveUniforms()
 {
-	glUseProgram(shaderProgramID);
-
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+	std::unordered_map<uint32_t, std::string> names;
+	int uniformCount = 0;
+	glGetProgramiv(shaderProgramID, GL_ACTIVE_UNIFORMS, &uniformCount);
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
+	for (int i = 0; i < uniformCount; i++)
 	{
-		uniformLocation = iterator->second;
-	}
+		char name[256];
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type;
+		glGetActiveUniform(shaderProgramID, i, sizeof(name), &length, &size, &type, name);
 
-	glUniform1i(uniformLocation, (int)value);
-}
+		int location = glGetUniformLocation(shaderProgramID, name);
 
-void Shader::SetInt(std::string name, int value)
-{
-	glUseProgram(shaderProgramID);
+		// Members of uniform blocks have no location
+		if (location == -1)
+			continue;
 
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+		AddHandle(uniformMap, names, UniformName::Hash(name), name, location);
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
+		// Arrays are reported once as "name[0]"; make the bare name and every other element resolve too
+		if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+		{
+			name[length - 3] = '\0';
+			AddHandle(uniformMap, names, UniformName::Hash(name), name, location);
+
+			for (int element = 1; element < size; element++)
+			{
+				std::string elementName = std::string(name) + "[" + std::to_string(element) + "]";
+				AddHandle(uniformMap, names, UniformName::Hash(elementName.c_str()), elementName.c_str(), glGetUniformLocation(shaderProgramID, elementName.c_str()));
+			}
+		}
 	}
-	else
+}
+
+void Shader::AddHandle(std::unordered_map<uint32_t, int>& map, std::unordered_map<uint32_t, std::string>& names, uint32_t hash, const char* name, int value)
+{
+	auto inserted = names.emplace(hash, name);
+
+	if (!inserted.second && inserted.first->second != name)
 	{
-		uniformLocation = iterator->second;
+		std::cout << "Shader uniforms " << inserted.first->second << " and " << name << " have the same hash" << std::endl;
+		assert(false && "Shader uniform hash collision");
 	}
 
-	glUniform1i(uniformLocation, value);
+	map.emplace(hash, value);
 }
 
-void Shader::SetFloat(std::string name, float value)
+int Shader::FindUniformHandle(uint32_t hash) const
 {
-	glUseProgram(shaderProgramID);
-
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+	// Names that are not active uniforms have no location, as with glGetUniformLocation
+	auto iterator = uniformMap.find(hash);
+	return iterator != uniformMap.end() ? iterator->second : -1;
+}
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
-	{
-		uniformLocation = iterator->second;
-	}
+int Shader::FindTextureUnit(uint32_t hash) const
+{
+	auto iterator = textureUnitMap.find(hash);
+	return iterator != textureUnitMap.end() ? iterator->second : -1;
+}
 
-	glUniform1f(uniformLocation, value);
+int Shader::GetUniformHandle(const UniformName& name)
+{
+	return FindUniformHandle(name.hash);
 }
 
-void Shader::SetVector2(std::string name, float x, float y)
+int Shader::GetUniformHandle(const std::string& name)
 {
-	glUseProgram(shaderProgramID);
+	return FindUniformHandle(UniformName::Hash(name.c_str()));
+}
 
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+void Shader::SetBool(int handle, bool value)
+{
+	glProgramUniform1i(shaderProgramID, handle, (int)value);
+}
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
-	{
-		uniformLocation = iterator->second;
-	}
+void Shader::SetInt(int handle, int value)
+{
+	glProgramUniform1i(shaderProgramID, handle, value);
+}
 
-	glUniform2f(uniformLocation, x, y);
+void Shader::SetFloat(int handle, float value)
+{
+	glProgramUniform1f(shaderProgramID, handle, value);
 }
 
-void Shader::SetVector3(std::string name, float x, float y, float z)
+void Shader::SetVector2(int handle, float x, float y)
 {
-	glUseProgram(shaderProgramID);
+	glProgramUniform2f(shaderProgramID, handle, x, y);
+}
 
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+void Shader::SetVector3(int handle, float x, float y, float z)
+{
+	glProgramUniform3f(shaderProgramID, handle, x, y, z);
+}
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
-	{
-		uniformLocation = iterator->second;
-	}
+void Shader::SetVector4(int handle, float x, float y, float z, float w)
+{
+	glProgramUniform4f(shaderProgramID, handle, x, y, z, w);
+}
 
-	glUniform3f(uniformLocation, x, y, z);
+void Shader::SetMatrix4x4(int handle, const Matrix4x4& matrix)
+{
+	glProgramUniformMatrix4fv(shaderProgramID, handle, 1, GL_FALSE, matrix.mV);
 }
 
-void Shader::SetVector4(std::string name, float x, float y, float z, float w)
+void Shader::SetBool(const std::string& name, bool value)
 {
 	glUseProgram(shaderProgramID);
+	glUniform1i(GetUniformHandle(name), (int)value);
+}
 
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+void Shader::SetInt(const std::string& name, int value)
+{
+	glUseProgram(shaderProgramID);
+	glUniform1i(GetUniformHandle(name), value);
+}
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
-	{
-		uniformLocation = iterator->second;
-	}
+void Shader::SetFloat(const std::string& name, float value)
+{
+	glUseProgram(shaderProgramID);
+	glUniform1f(GetUniformHandle(name), value);
+}
 
-	glUniform4f(uniformLocation, x, y, z, w);
+void Shader::SetVector2(const std::string& name, float x, float y)
+{
+	glUseProgram(shaderProgramID);
+	glUniform2f(GetUniformHandle(name), x, y);
 }
 
-void Shader::SetMatrix4x4(std::string name, Matrix4x4 matrix)
+void Shader::SetVector3(const std::string& name, float x, float y, float z)
 {
 	glUseProgram(shaderProgramID);
+	glUniform3f(GetUniformHandle(name), x, y, z);
+}
 
-	auto iterator = uniformMap.find(name);
-	int uniformLocation;
+void Shader::SetVector4(const std::string& name, float x, float y, float z, float w)
+{
+	glUseProgram(shaderProgramID);
+	glUniform4f(GetUniformHandle(name), x, y, z, w);
+}
 
-	if (iterator == uniformMap.end())
-	{
-		uniformLocation = glGetUniformLocation(shaderProgramID, name.c_str());
-		uniformMap.emplace(name, uniformLocation);
-	}
-	else
-	{
-		uniformLocation = iterator->second;
-	}
+void Shader::SetMatrix4x4(const std::string& name, const Matrix4x4& matrix)
+{
+	glUseProgram(shaderProgramID);
+	glUniformMatrix4fv(GetUniformHandle(name), 1, GL_FALSE, matrix.mV);
+}
 
-	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, matrix.mV);
+bool Shader::HasUniform(const UniformName& name)
+{
+	return GetUniformHandle(name) != -1;
 }
 
-bool Shader::HasUniform(std::string name)
+bool Shader::HasUniform(const std::string& name)
 {
-	return glGetUniformLocation(shaderProgramID, name.c_str()) != -1;
+	return GetUniformHandle(name) != -1;
 }
 
-int Shader::GetTextureUnit(std::string name)
+int Shader::GetTextureUnit(const UniformName& name)
 {
-	auto result = textureUnitMap.find(name);
+	return FindTextureUnit(name.hash);
+}
 
-	return result == textureUnitMap.end() ? -1 : result->second;
+int Shader::GetTextureUnit(const std::string& name)
+{
+	return FindTextureUnit(UniformName::Hash(name.c_str()));
 }
\ No newline at end of file
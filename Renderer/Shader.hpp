@@ -5,27 +5,53 @@
 #include <unordered_map>
 
 #include "../Core/Math/Matrix4x4.hpp"
+#include "ShaderUniforms.hpp"
 
 class Shader
 {
 public:
 	Shader(const std::string& shaderPath);
 	void Use();
-	void SetBool(std::string name, bool value);
-	void SetInt(std::string name, int value);
-	void SetFloat(std::string name, float value);
-	void SetVector2(std::string name, float x, float y);
-	void SetVector3(std::string name, float x, float y, float z);
-	void SetVector4(std::string name, float x, float y, float z, float w);
-	void SetMatrix4x4(std::string name, Matrix4x4 matrix);
-	int GetTextureUnit(std::string name);
-	bool HasUniform(std::string name);
+	void SetBool(const std::string& name, bool value);
+	void SetInt(const std::string& name, int value);
+	void SetFloat(const std::string& name, float value);
+	void SetVector2(const std::string& name, float x, float y);
+	void SetVector3(const std::string& name, float x, float y, float z);
+	void SetVector4(const std::string& name, float x, float y, float z, float w);
+	void SetMatrix4x4(const std::string& name, const Matrix4x4& matrix);
+
+	// Handle based setters. Handles are resolved once with GetUniformHandle and stay valid for the lifetime of the shader;
+	// these do not require the shader to be in use.
+	int GetUniformHandle(const UniformName& name);
+	int GetUniformHandle(const std::string& name);
+	void SetBool(int handle, bool value);
+	void SetInt(int handle, int value);
+	void SetFloat(int handle, float value);
+	void SetVector2(int handle, float x, float y);
+	void SetVector3(int handle, float x, float y, float z);
+	void SetVector4(int handle, float x, float y, float z, float w);
+	void SetMatrix4x4(int handle, const Matrix4x4& matrix);
+
+	int GetTextureUnit(const UniformName& name);
+	int GetTextureUnit(const std::string& name);
+	bool HasUniform(const UniformName& name);
+	bool HasUniform(const std::string& name);
+	bool UsesViewData() const { return usesViewData; }
+	bool UsesInstancing() const { return usesInstancing; }
 private:
 	void CheckCompileErrors(unsigned int shader, std::string type);
 	void Compile(const std::string& vertexSource, const std::string& framentSource);
 	int shaderProgramID;
-	std::unordered_map<std::string, int> textureUnitMap;
-	std::unordered_map<std::string, int> uniformMap;
+	bool usesViewData = false;
+	bool usesInstancing = false;
+	void ResolveActiveUniforms();
+
+	// Every name is hashed once here and a collision fails loudly, so lookups afterwards only compare hashes
+	static void AddHandle(std::unordered_map<uint32_t, int>& map, std::unordered_map<uint32_t, std::string>& names, uint32_t hash, const char* name, int value);
+	int FindUniformHandle(uint32_t hash) const;
+	int FindTextureUnit(uint32_t hash) const;
+	std::unordered_map<uint32_t, int> textureUnitMap;
+	std::unordered_map<uint32_t, int> uniformMap;
 };
 
 #endif
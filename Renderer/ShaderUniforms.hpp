@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A uniform name paired with its FNV-1a hash, hashed at compile time so lookups through Shader::GetUniformHandle
+// never allocate or hash strings at runtime. The name is not copied, so only string literals are accepted;
+// names only known at runtime go through the std::string overloads of Shader.
+struct UniformName
+{
+	uint32_t hash;
+	const char* name;
+
+	template<size_t N>
+	explicit constexpr UniformName(const char (&literal)[N]) : hash(Hash(literal)), name(literal) {};
+
+	static constexpr uint32_t Hash(const char* text)
+	{
+		uint32_t result = 2166136261u;
+
+		for (const char* c = text; *c != '\0'; c++)
+		{
+			result ^= (uint32_t)(unsigned char)*c;
+			result *= 16777619u;
+		}
+
+		return result;
+	}
+};
+
+namespace EngineUniforms
+{
+	static constexpr UniformName model("model");
+	static constexpr UniformName instanceOffset("instanceOffset");
+	static constexpr UniformName projection("projection");
+	static constexpr UniformName view("view");
+	static constexpr UniformName camPos("camPos");
+	static constexpr UniformName nearPlane("nearPlane");
+	static constexpr UniformName farPlane("farPlane");
+	static constexpr UniformName screenWidth("screenWidth");
+	static constexpr UniformName screenHeight("screenHeight");
+	static constexpr UniformName ambientLighting("ambientLighting");
+	static constexpr UniformName clusterScreenSpaceSize("clusterScreenSpaceSize");
+	static constexpr UniformName lightSpaceMatrix("lightSpaceMatrix");
+	static constexpr UniformName lightPos("lightPos");
+	static constexpr UniformName lightRadius("lightRadius");
+	static constexpr UniformName mainTex("mainTex");
+	static constexpr UniformName pointShadowMap("pointShadowMap");
+	static constexpr UniformName pointShadowAtlas("pointShadowAtlas");
+}
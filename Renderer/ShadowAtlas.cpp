@@ -0,0 +1,271 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static const int s_MinTileSize = 64;
+static const int s_MaxTileSize = 1024;
+static const int s_MinAtlasSize = 1024;
+static const int s_MaxAtlasSize = 8192;
+static const size_t s_BytesPerTexel = 4;
+
+// A light keeps its tile size until it is clearly larger or smaller on screen, so lights near a boundary are not re-rendered every frame
+static const float s_ShrinkThreshold = 0.75f;
+static const float s_GrowThreshold = 2.5f;
+
+ShadowAtlas::ShadowAtlas(size_t budget)
+{
+	SetBudget(budget);
+}
+
+void ShadowAtlas::SetBudget(size_t bytes)
+{
+	budget = bytes;
+
+	int newSize = s_MinAtlasSize;
+
+	while (newSize < s_MaxAtlasSize && (size_t)newSize * 2 * newSize * 2 * s_BytesPerTexel <= budget)
+		newSize *= 2;
+
+	if (texture && newSize == size)
+		return;
+
+	if (texture)
+	{
+		GLuint textureID = texture->GetTextureID();
+		glDeleteTextures(1, &textureID);
+	}
+
+	size = newSize;
+	texture = std::make_unique<Texture>((float)size, (float)size, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_NEAREST, GL_CLAMP_TO_EDGE);
+
+	allocations.clear();
+	freeTiles.assign(GetLevel(s_MinTileSize) + 1, std::vector<ShadowTile>());
+	freeTiles[0].push_back({ 0, 0, size });
+	usedArea = 0;
+}
+
+void ShadowAtlas::Assign(std::vector<ShadowRequest>& requests)
+{
+	frame++;
+
+	std::sort(requests.begin(), requests.end(), [](const ShadowRequest& a, const ShadowRequest& b) { return a.pixels > b.pixels; });
+
+	// Largest power of two the light covers on screen, limited so at least a few lights fit at the top size
+	int maxTileSize = std::min(s_MaxTileSize, size / 4);
+	size_t area = 0;
+
+	for (ShadowRequest& request : requests)
+	{
+		int tileSize = s_MinTileSize;
+
+		while (tileSize < maxTileSize && tileSize * 2 <= request.pixels)
+			tileSize *= 2;
+
+		auto found = allocations.find(request.light);
+
+		if (found != allocations.end())
+		{
+			int currentSize = found->second.tileSize;
+
+			if (request.pixels >= currentSize * s_ShrinkThreshold && request.pixels < currentSize * s_GrowThreshold)
+				tileSize = currentSize;
+		}
+
+		request.tileSize = tileSize;
+		area += (size_t)6 * tileSize * tileSize;
+	}
+
+	// Over budget, the least important lights step down a size at a time, and lose their shadows only once all are at the smallest size
+	size_t atlasArea = (size_t)size * size;
+	bool shrunk = true;
+
+	while (area > atlasArea && shrunk)
+	{
+		shrunk = false;
+
+		for (auto it = requests.rbegin(); it != requests.rend() && area > atlasArea; ++it)
+		{
+			if (it->tileSize > s_MinTileSize)
+			{
+				area -= (size_t)6 * (it->tileSize * it->tileSize - (it->tileSize / 2) * (it->tileSize / 2));
+				it->tileSize /= 2;
+				shrunk = true;
+			}
+		}
+	}
+
+	for (auto it = requests.rbegin(); it != requests.rend() && area > atlasArea; ++it)
+	{
+		area -= (size_t)6 * it->tileSize * it->tileSize;
+		it->tileSize = 0;
+	}
+
+	// Tiles of lights that changed size or are gone go back first, so the others can use the space
+	for (ShadowRequest& request : requests)
+	{
+		auto found = allocations.find(request.light);
+
+		if (found == allocations.end())
+			continue;
+
+		if (found->second.tileSize == request.tileSize)
+		{
+			found->second.frame = frame;
+		}
+		else
+		{
+			Free(found->second);
+			allocations.erase(found);
+		}
+	}
+
+	for (auto it = allocations.begin(); it != allocations.end();)
+	{
+		if (it->second.frame != frame)
+		{
+			Free(it->second);
+			it = allocations.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	usedArea = 0;
+
+	for (ShadowRequest& request : requests)
+	{
+		auto found = allocations.find(request.light);
+
+		if (found == allocations.end() && request.tileSize > 0)
+		{
+			Allocation allocation;
+
+			// The quadtree can be too fragmented for the wanted size even under budget, so smaller sizes are tried before giving up
+			while (request.tileSize >= s_MinTileSize && !Allocate(request.tileSize, allocation.faces))
+				request.tileSize /= 2;
+
+			if (request.tileSize < s_MinTileSize)
+			{
+				request.tileSize = 0;
+				continue;
+			}
+
+			allocation.tileSize = request.tileSize;
+			allocation.frame = frame;
+			found = allocations.emplace(request.light, allocation).first;
+		}
+
+		if (found == allocations.end())
+			continue;
+
+		std::copy(found->second.faces, found->second.faces + 6, request.faces);
+		usedArea += (size_t)6 * request.tileSize * request.tileSize;
+	}
+}
+
+PointShadowGLSL ShadowAtlas::GetShadowData(const ShadowRequest& request) const
+{
+	// Zeroed as a whole so the padding compares equal from one frame to the next
+	PointShadowGLSL data;
+	memset((void*)&data, 0, sizeof(PointShadowGLSL));
+
+	if (request.tileSize == 0)
+		return data;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const ShadowTile& even = request.faces[i * 2];
+		const ShadowTile& odd = request.faces[i * 2 + 1];
+		data.faceOffsets[i] = Vector4(even.x / (float)size, even.y / (float)size, odd.x / (float)size, odd.y / (float)size);
+	}
+
+	data.tileSize = request.tileSize / (float)size;
+	return data;
+}
+
+int ShadowAtlas::GetLevel(int tileSize) const
+{
+	int level = 0;
+
+	for (int levelSize = size; levelSize > tileSize; levelSize /= 2)
+		level++;
+
+	return level;
+}
+
+bool ShadowAtlas::AllocateTile(int level, ShadowTile& tile)
+{
+	if (level < 0)
+		return false;
+
+	if (!freeTiles[level].empty())
+	{
+		tile = freeTiles[level].back();
+		freeTiles[level].pop_back();
+		return true;
+	}
+
+	// Split a free tile from the level above into quarters, keeping one and freeing the other three
+	ShadowTile parent;
+
+	if (!AllocateTile(level - 1, parent))
+		return false;
+
+	int half = parent.size / 2;
+	tile = { parent.x, parent.y, half };
+	freeTiles[level].push_back({ parent.x + half, parent.y + half, half });
+	freeTiles[level].push_back({ parent.x, parent.y + half, half });
+	freeTiles[level].push_back({ parent.x + half, parent.y, half });
+	return true;
+}
+
+void ShadowAtlas::FreeTile(int level, const ShadowTile& tile)
+{
+	std::vector<ShadowTile>& tiles = freeTiles[level];
+
+	if (level > 0)
+	{
+		// Once all four quarters of a tile are free it merges back into one
+		int parentSize = tile.size * 2;
+		ShadowTile parent = { tile.x - tile.x % parentSize, tile.y - tile.y % parentSize, parentSize };
+		auto inParent = [&parent](const ShadowTile& other) { return other.x - other.x % parent.size == parent.x && other.y - other.y % parent.size == parent.y; };
+
+		if (std::count_if(tiles.begin(), tiles.end(), inParent) == 3)
+		{
+			tiles.erase(std::remove_if(tiles.begin(), tiles.end(), inParent), tiles.end());
+			FreeTile(level - 1, parent);
+			return;
+		}
+	}
+
+	tiles.push_back(tile);
+}
+
+bool ShadowAtlas::Allocate(int tileSize, ShadowTile* faces)
+{
+	int level = GetLevel(tileSize);
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (!AllocateTile(level, faces[i]))
+		{
+			for (int j = 0; j < i; j++)
+				FreeTile(level, faces[j]);
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ShadowAtlas::Free(const Allocation& allocation)
+{
+	int level = GetLevel(allocation.tileSize);
+
+	for (int i = 0; i < 6; i++)
+		FreeTile(level, allocation.faces[i]);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Texture.hpp"
+#include "../Vendor/entt/entt.hpp"
+#include "../Core/Math/Vector3.hpp"
+#include "../Core/Math/Vector4.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+static const int POINT_SHADOW_BINDING = 7;
+
+// Pixel square of one cube face in the atlas
+struct ShadowTile
+{
+	int x;
+	int y;
+	int size;
+};
+
+// Where a point light's faces are in the atlas, in texture coordinates: face 2i at faceOffsets[i].xy and face 2i+1 at .zw.
+// A tile size of zero means the light has no shadow map.
+struct PointShadowGLSL
+{
+	Vector4 faceOffsets[3];
+	float tileSize;
+	float padding[3];
+};
+
+struct ShadowRequest
+{
+	entt::entity light;
+	int lightIndex;
+	Vector3 position;
+	float radius;
+
+	// How large the light's sphere of influence is on screen
+	float pixels;
+
+	// Filled in by ShadowAtlas::Assign
+	int tileSize;
+	ShadowTile faces[6];
+};
+
+// One depth texture holding the six faces of every shadowed point light. Faces are square tiles taken from a quadtree;
+// each light gets a tile size from its size on screen, and the least important lights shrink first when they do not all fit.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(size_t budget);
+
+	// The atlas is the largest power of two square that fits the budget; changing it drops every tile
+	void SetBudget(size_t bytes);
+	size_t GetBudget() const { return budget; }
+	int GetSize() const { return size; }
+	Texture& GetTexture() { return *texture; }
+
+	// Sorts the requests most important first and gives each its tiles. Lights keep their tiles while their size holds,
+	// so their cached maps stay valid; lights gone since the last call give theirs back.
+	void Assign(std::vector<ShadowRequest>& requests);
+
+	size_t GetUsedArea() const { return usedArea; }
+	PointShadowGLSL GetShadowData(const ShadowRequest& request) const;
+private:
+	struct Allocation
+	{
+		int tileSize;
+		ShadowTile faces[6];
+		uint32_t frame;
+	};
+
+	int GetLevel(int tileSize) const;
+	bool AllocateTile(int level, ShadowTile& tile);
+	void FreeTile(int level, const ShadowTile& tile);
+	bool Allocate(int tileSize, ShadowTile* faces);
+	void Free(const Allocation& allocation);
+
+	std::unique_ptr<Texture> texture;
+	size_t budget;
+	int size = 0;
+	size_t usedArea = 0;
+
+	// Free tiles by level, level 0 being the whole atlas and each level below it half the size
+	std::vector<std::vector<ShadowTile>> freeTiles;
+	std::unordered_map<entt::entity, Allocation> allocations;
+	uint32_t frame = 0;
+};
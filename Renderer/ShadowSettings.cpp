@@ -8,8 +8,27 @@
 #include "../Core/Transform.hpp"
 #include "../Core/Math/Mathf.hpp"
 #include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include "Skybox.hpp"
+#include "Frustum.hpp"
+#include "AnimationSystem.hpp"
 
+// Compared bit for bit, so a caster drifting slowly still counts as moving every frame
+template<typename T>
+static bool SameBytes(const T& a, const T& b)
+{
+	return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+static bool BoundsTouchSphere(const Bounds& bounds, const Vector3& center, float radius)
+{
+	Vector3 closestPoint = Vector3::Max(bounds.GetMin(), Vector3::Min(center, bounds.GetMax()));
+	return Vector3::DistanceSquared(closestPoint, center) <= radius * radius;
+}
+
+static const size_t s_DefaultShadowAtlasBudget = 64 * 1024 * 1024;
 
 ShadowSettings::ShadowSettings(std::shared_ptr<entt::registry> registry)
 {
@@ -17,7 +36,10 @@ ShadowSettings::ShadowSettings(std::shared_ptr<entt::registry> registry)
 	shadowCubeMap = std::make_unique<Cubemap>(GL_LINEAR, 256, 256);
 	cube = new Mesh("Resources/sphere.obj");
 	cubeShader = new Shader("Resources/cubecube.shader");
-	shadowCubeMapArray = std::make_unique<CubemapArray>(256);
+	shadowAtlas = std::make_unique<ShadowAtlas>(s_DefaultShadowAtlasBudget);
+
+	// Allocated up front so the lit shaders have a buffer bound before the first shadowed light shows up
+	pointShadowSSBO.Orphan(POINT_SHADOW_BINDING, sizeof(PointShadowGLSL));
 
 	/*
 	shadowMap = new Texture(1024, 1024, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_NEAREST, GL_CLAMP_TO_BORDER);
@@ -29,177 +51,324 @@ ShadowSettings::ShadowSettings(std::shared_ptr<entt::registry> registry)
 	*/
 }
 
-/*void ShadowSettings::TempDirectionalLight(std::shared_ptr<Camera> camera, Matrix4x4& view)
+void ShadowSettings::GatherShadowCasters()
 {
-	// 1. GET DIRECTIONAL LIGHT
+	shadowCasters.clear();
 
-	std::shared_ptr<DirectionalLight> directionalLight;
-	std::shared_ptr<Transform> transform;
-	registry->view<Transform, DirectionalLight>().each([&transform, &directionalLight](auto& trans, auto& light)
+	registry->view<Transform, MeshRenderer>().each([this](auto entity, auto& transform, auto& meshRenderer)
 	{
-		transform = std::make_shared<Transform>(trans);
-		directionalLight = std::make_shared<DirectionalLight>(light);
-	});
+		if (!meshRenderer.castsShadows || meshRenderer.mesh == nullptr)
+			return;
 
-	if (directionalLight == nullptr)
-		return;
+		// Animated casters reuse the pose evaluated for the frame by AnimationSystem
+		ShadowCaster caster;
+		caster.entity = entity;
+		caster.mesh = meshRenderer.mesh.get();
+		caster.bonePalette = AnimationSystem::GetBonePalette(*registry, entity, caster.mesh);
+		caster.model = Matrix4x4::Transformation(transform);
+		caster.worldBounds = meshRenderer.mesh->GetBounds().Transformed(caster.model);
+		caster.lod = 0;
+		shadowCasters.push_back(caster);
+	});
+}
 
-	// 2. CREATE FRAMEBUFFER
+void ShadowSettings::FindChangedCasters()
+{
+	changedBounds.clear();
+	currentCasters.clear();
 
-	Framebuffer offscreenFramebuffer;
-	offscreenFramebuffer.AttachTexture(*shadowMap, GL_DEPTH_ATTACHMENT);
+	for (const ShadowCaster& caster : shadowCasters)
+	{
+		CachedShadowCaster current = { caster.mesh, caster.model, caster.worldBounds };
+		auto found = cachedCasters.find(caster.entity);
 
-	// 3. CALCULATE BOUNDS TO COVER FRUSTUM
+		// Animated casters change shape without moving, so they invalidate the lights around them every frame
+		if (found == cachedCasters.end())
+		{
+			changedBounds.push_back(caster.worldBounds);
+		}
+		else
+		{
+			if (caster.bonePalette != nullptr || found->second.mesh != caster.mesh || !SameBytes(found->second.model, caster.model) || !SameBytes(found->second.worldBounds, caster.worldBounds))
+			{
+				changedBounds.push_back(found->second.worldBounds);
+				changedBounds.push_back(caster.worldBounds);
+			}
 
-	float FOV = camera->fov + 2.0f;
+			cachedCasters.erase(found);
+		}
 
-	Matrix4x4 viewInverse = Matrix4x4::AffineInverse(view);
-	Matrix4x4 lightView = Matrix4x4::LookAt(Vector3::zero, directionalLight->direction, Vector3::one);
+		currentCasters.emplace(caster.entity, current);
+	}
 
-	float aspectRatio = (float)Window::GetInstance()->GetViewportWidth() / (float)Window::GetInstance()->GetViewportHeight();
-	float tanHalfHFOV = tanf(kDegToRad * (FOV / 2.0f));
-	float tanHalfVFOV = tanf(kDegToRad * ((FOV * aspectRatio) / 2.0f));
+	// What is left was removed or stopped casting, and leaves a gap in the shadows it used to cast
+	for (auto& entry : cachedCasters)
+		changedBounds.push_back(entry.second.worldBounds);
 
-	float xn = camera->nearPlane * tanHalfHFOV;
-	float xf = camera->farPlane * tanHalfHFOV;
-	float yn = camera->nearPlane * tanHalfVFOV;
-	float yf = camera->farPlane * tanHalfVFOV;
+	cachedCasters.swap(currentCasters);
+}
 
-	Vector4 frustumCornersL[8];
-	Vector4 frustumCorners[8] =
+bool ShadowSettings::IsTouchedByChangedCaster(const Vector3& position, float radius) const
+{
+	for (const Bounds& bounds : changedBounds)
 	{
-		Vector4(xn, yn, -camera->nearPlane, 1.0f),
-		Vector4(-xn, yn, -camera->nearPlane, 1.0f),
-		Vector4(xn, -yn, -camera->nearPlane, 1.0f),
-		Vector4(-xn, -yn, -camera->nearPlane, 1.0f),
-
-		Vector4(xf, yf, -camera->farPlane, 1.0f),
-		Vector4(-xf, yf, -camera->farPlane, 1.0f),
-		Vector4(xf, -yf, -camera->farPlane, 1.0f),
-		Vector4(-xf, -yf, -camera->farPlane, 1.0f)
-	};
+		if (BoundsTouchSphere(bounds, position, radius))
+			return true;
+	}
 
-	float minX = INFINITY;
-	float maxX = -INFINITY;
-	float minY = INFINITY;
-	float maxY = -INFINITY;
-	float minZ = INFINITY;
-	float maxZ = -INFINITY;
+	return false;
+}
+
+void ShadowSettings::AddView(const Vector3& cameraPosition, float pixelsPerUnit)
+{
+	views.push_back({ cameraPosition, pixelsPerUnit });
+}
 
-	for (int j = 0; j < 8; j++)
+void ShadowSettings::RenderPointLightShadows()
+{
+	GatherShadowCasters();
+	FindChangedCasters();
+	shadowDraws = 0;
+	shadowDrawsSaved = 0;
+	shadowDrawCalls = 0;
+	shadowMapsRendered = 0;
+	shadowMapsCached = 0;
+
+	// Lights are ranked by how large their sphere of influence is on screen, in whichever view shows it largest
+	shadowRequests.clear();
+	int pointLightCount = 0;
+
+	registry->view<Transform, PointLight>().each([&](auto entity, auto& trans, auto& light)
 	{
-		Vector4 vW = viewInverse * frustumCorners[j];
+		if (light.castsShadows)
+		{
+			ShadowRequest request;
+			request.light = entity;
+			request.lightIndex = pointLightCount;
+			request.position = trans.position;
+			request.radius = light.radius;
+			request.pixels = 0.0f;
+
+			for (const ShadowView& view : rankedViews)
+			{
+				// From inside the radius the light's shadows can cover the whole screen
+				float distance = Vector3::Distance(trans.position, view.position);
+				request.pixels = std::max(request.pixels, distance > light.radius ? light.radius / distance * view.pixelsPerUnit : FLT_MAX);
+			}
 
-		frustumCornersL[j] = lightView * vW;
+			shadowRequests.push_back(request);
+		}
 
-		minX = std::min(minX, frustumCornersL[j].x);
-		maxX = std::max(maxX, frustumCornersL[j].x);
-		minY = std::min(minY, frustumCornersL[j].y);
-		maxY = std::max(maxY, frustumCornersL[j].y);
-		minZ = std::min(minZ, -frustumCornersL[j].z);
-		maxZ = std::max(maxZ, -frustumCornersL[j].z);
-	}
+		pointLightCount++;
+	});
 
-	// 3. RENDER SCENE FROM LIGHTS PERSPECTIVE
+	shadowAtlas->Assign(shadowRequests);
 
-	Matrix4x4 lightProjection = Matrix4x4::Orthographic(minX, maxX, minY, maxY, minZ - 50.0f, maxZ);
+	// Indexed like the point light buffer, with no tiles for lights without shadows
+	pointShadows.resize(pointLightCount);
 
-	lightSpaceMatrix = lightProjection * lightView;
-	std::shared_ptr<Shader> depthShader = ResourceManager::GetInstance()->GetShader("Resources/Clustered/shadowMappingDepth.shader");
-	depthShader->Use();
-	depthShader->SetMatrix4x4("lightSpaceMatrix", lightSpaceMatrix);
+	if (!pointShadows.empty())
+		memset((void*)pointShadows.data(), 0, pointShadows.size() * sizeof(PointShadowGLSL));
 
-	glViewport(0, 0, 1024, 1024);
-	offscreenFramebuffer.Bind();
-	Window::GetInstance()->Clear();
+	currentShadowMaps.clear();
 
-	registry->view<Transform, MeshRenderer>().each([&depthShader](auto& transform, auto& meshRenderer)
+	for (const ShadowRequest& request : shadowRequests)
 	{
-		Matrix4x4 model = Matrix4x4::Transformation(transform);
-		depthShader->SetMatrix4x4("model", model);
-		meshRenderer.mesh->Render(depthShader, 0.01f);
-	});
+		PointShadowGLSL shadow = shadowAtlas->GetShadowData(request);
+		pointShadows[request.lightIndex] = shadow;
+
+		if (request.tileSize == 0)
+			continue;
 
-	Framebuffer::Unbind();
-	Window::GetInstance()->ResetDimensions();
-	Window::GetInstance()->Clear();
+		// A map stays valid while its light keeps the same tiles and nothing around it changes
+		CachedShadowMap cached = { request.position, request.radius, shadow };
+		auto found = cachedShadowMaps.find(request.light);
+		currentShadowMaps.emplace(request.light, cached);
+
+		if (found != cachedShadowMaps.end() && SameBytes(found->second.position, cached.position) && found->second.radius == cached.radius &&
+			SameBytes(found->second.shadow, cached.shadow) && !IsTouchedByChangedCaster(request.position, request.radius))
+		{
+			shadowMapsCached++;
+			continue;
+		}
+
+		if (shadowMapsRendered == 0)
+		{
+			atlasFramebuffer.AttachTexture(shadowAtlas->GetTexture(), GL_DEPTH_ATTACHMENT);
+			atlasFramebuffer.Bind();
+			glEnable(GL_SCISSOR_TEST);
+		}
+
+		RenderPointLightShadow(request);
+		shadowMapsRendered++;
+	}
+
+	cachedShadowMaps.swap(currentShadowMaps);
+
+	// Lights that no longer have a map forget their casters' levels
+	for (auto entry = shadowLods.begin(); entry != shadowLods.end();)
+	{
+		if (cachedShadowMaps.find(entry->first) == cachedShadowMaps.end())
+			entry = shadowLods.erase(entry);
+		else
+			++entry;
+	}
 
-	// 4. OPTIONALLY RENDER SHADOW TEXTURE TO SCREEN
+	if (shadowMapsRendered > 0)
+	{
+		glDisable(GL_SCISSOR_TEST);
+		Framebuffer::Unbind();
+		Window::GetInstance()->ResetDimensions();
+		Window::GetInstance()->Clear();
+	}
 
-	return;
-	Mesh quad("Resources/PBR/FullscreenQuad.obj");
-	Shader quadShader("Resources/texture.shader");
-	quadShader.Use();
-	shadowMap->Bind(quadShader.GetTextureUnit("mainTex"));
-	quad.Render();
-}*/
+	if (pointShadows.size() != uploadedPointShadows.size() || (!pointShadows.empty() && memcmp(pointShadows.data(), uploadedPointShadows.data(), pointShadows.size() * sizeof(PointShadowGLSL)) != 0))
+	{
+		pointShadowSSBO.Orphan(POINT_SHADOW_BINDING, std::max(pointShadows.size(), (size_t)1) * sizeof(PointShadowGLSL));
+		pointShadowSSBO.SetRange(0, pointShadows.size() * sizeof(PointShadowGLSL), pointShadows.data());
+		uploadedPointShadows = pointShadows;
+	}
+}
 
-void ShadowSettings::RenderPointLightShadows(std::shared_ptr<Camera> camera, Matrix4x4& view)
+void ShadowSettings::RenderPointLightShadow(const ShadowRequest& request)
 {
-	Framebuffer offscreenFramebuffer;
+	// Only casters overlapping the light's sphere of influence can contribute to its shadow
+	lightCasters.clear();
+	std::unordered_map<entt::entity, int>& previousLods = shadowLods[request.light];
+	currentShadowLods.clear();
 
-	int pointLightIndex = 0;
-	registry->view<Transform, PointLight>().each([&offscreenFramebuffer, &pointLightIndex, this](auto& trans, auto& light)
+	for (ShadowCaster& caster : shadowCasters)
 	{
-		if (!light.castsShadows)
+		if (BoundsTouchSphere(caster.worldBounds, request.position, request.radius))
 		{
-			pointLightIndex++;
-			return;
+			// Each cube face covers a 90 degree view, so screen size is the bounding radius over the distance to the light
+			float distance = std::max(Vector3::Distance(caster.worldBounds.center, request.position), 0.01f);
+			auto previous = previousLods.find(caster.entity);
+			caster.lod = caster.mesh->SelectLod(caster.worldBounds.radius / distance, previous != previousLods.end() ? previous->second : -1);
+			currentShadowLods[caster.entity] = caster.lod;
+			lightCasters.push_back(&caster);
 		}
+	}
+
+	previousLods.swap(currentShadowLods);
+
+	Matrix4x4 captureProjection = Matrix4x4::Perspective(90.0f * kDegToRad, 1.0f, 0.01f, request.radius);
+	Matrix4x4 captureViews[] =
+	{
+		Matrix4x4::LookAt(request.position, request.position + Vector3(1.0f,  0.0f,  0.0f), Vector3(0.0f, -1.0f,  0.0f)),
+		Matrix4x4::LookAt(request.position, request.position + Vector3(-1.0f,  0.0f,  0.0f), Vector3(0.0f, -1.0f,  0.0f)),
+		Matrix4x4::LookAt(request.position, request.position + Vector3(0.0f,  1.0f,  0.0f), Vector3(0.0f,  0.0f,  1.0f)),
+		Matrix4x4::LookAt(request.position, request.position + Vector3(0.0f, -1.0f,  0.0f), Vector3(0.0f,  0.0f, -1.0f)),
+		Matrix4x4::LookAt(request.position, request.position + Vector3(0.0f,  0.0f,  1.0f), Vector3(0.0f, -1.0f,  0.0f)),
+		Matrix4x4::LookAt(request.position, request.position + Vector3(0.0f,  0.0f, -1.0f), Vector3(0.0f, -1.0f,  0.0f))
+	};
+
+	// Cull every face up front so the light's model matrices go up in a single upload.
+	// Casters are sorted by mesh and level of detail so that identical meshes visible in a face collapse into one instanced draw.
+	std::sort(lightCasters.begin(), lightCasters.end(), [](const ShadowCaster* a, const ShadowCaster* b) { return a->mesh < b->mesh || (a->mesh == b->mesh && a->lod < b->lod); });
 
-		GLenum err;
+	Matrix4x4 pointMatrices[6];
+	int faceBatchStart[7];
+	int drawsBeforeLight = shadowDraws;
+
+	instanceModels.clear();
+	shadowBatches.clear();
+
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		pointMatrices[i] = captureProjection * captureViews[i];
+		Frustum faceFrustum(pointMatrices[i]);
+		faceBatchStart[i] = (int)shadowBatches.size();
 
-		Matrix4x4 captureProjection = Matrix4x4::Perspective(90.0f * kDegToRad, 1.0f, 0.01f, light.radius);
-		Matrix4x4 captureViews[] =
+		for (ShadowCaster* caster : lightCasters)
 		{
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(1.0f,  0.0f,  0.0f), Vector3(0.0f, -1.0f,  0.0f)),
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(-1.0f,  0.0f,  0.0f), Vector3(0.0f, -1.0f,  0.0f)),
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(0.0f,  1.0f,  0.0f), Vector3(0.0f,  0.0f,  1.0f)),
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(0.0f, -1.0f,  0.0f), Vector3(0.0f,  0.0f, -1.0f)),
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(0.0f,  0.0f,  1.0f), Vector3(0.0f, -1.0f,  0.0f)),
-			Matrix4x4::LookAt(trans.position, trans.position + Vector3(0.0f,  0.0f, -1.0f), Vector3(0.0f, -1.0f,  0.0f))
-		};
-
-		glViewport(0, 0, 256, 256);
-		Window::GetInstance()->Clear();
+			if (!faceFrustum.IsVisible(caster->worldBounds))
+				continue;
+
+			if ((int)shadowBatches.size() > faceBatchStart[i] && shadowBatches.back().mesh == caster->mesh && shadowBatches.back().lod == caster->lod && !caster->mesh->IsAnimated())
+			{
+				shadowBatches.back().instanceCount++;
+			}
+			else
+			{
+				ShadowBatch batch;
+				batch.mesh = caster->mesh;
+				batch.bonePalette = caster->bonePalette;
+				batch.lod = caster->lod;
+				batch.firstInstance = (int)instanceModels.size();
+				batch.instanceCount = 1;
+				shadowBatches.push_back(batch);
+			}
+
+			instanceModels.push_back(caster->model);
+			shadowDraws++;
+		}
+	}
 
-		for (unsigned int i = 0; i < 6; i++)
+	faceBatchStart[6] = (int)shadowBatches.size();
+	instanceBuffer.Upload(instanceModels);
+
+	std::shared_ptr<Shader> depthShaders[] =
+	{
+		ResourceManager::GetInstance()->GetShader("Resources/Engine/Shaders/Shadows/PointShadowDepth.shader"),
+		ResourceManager::GetInstance()->GetShader("Resources/Engine/Shaders/Shadows/PointShadowDepthSkinned.shader")
+	};
+
+	for (std::shared_ptr<Shader>& depthShader : depthShaders)
+	{
+		depthShader->SetVector3(depthShader->GetUniformHandle(EngineUniforms::lightPos), request.position.x, request.position.y, request.position.z);
+		depthShader->SetFloat(depthShader->GetUniformHandle(EngineUniforms::lightRadius), request.radius);
+	}
+
+	// Each face only clears and draws inside its own tile
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		for (std::shared_ptr<Shader>& depthShader : depthShaders)
+			depthShader->SetMatrix4x4(depthShader->GetUniformHandle(EngineUniforms::lightSpaceMatrix), pointMatrices[i]);
+
+		Shader* activeShader = nullptr;
+		const ShadowTile& tile = request.faces[i];
+
+		glViewport(tile.x, tile.y, tile.size, tile.size);
+		glScissor(tile.x, tile.y, tile.size, tile.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		for (int b = faceBatchStart[i]; b < faceBatchStart[i + 1]; b++)
 		{
-			Matrix4x4 pointMatrix = captureProjection * captureViews[i];
-			std::shared_ptr<Shader> depthShader = ResourceManager::GetInstance()->GetShader("Resources/Engine/Shaders/Shadows/PointShadowDepth.shader");
-			depthShader->Use();
-			depthShader->SetMatrix4x4("lightSpaceMatrix", pointMatrix);
-			depthShader->SetVector3("lightPos", trans.position.x, trans.position.y, trans.position.z);
-			depthShader->SetFloat("lightRadius", light.radius);
-
-			offscreenFramebuffer.AttachCubemapArrayFace(*shadowCubeMapArray, pointLightIndex, i, GL_DEPTH_ATTACHMENT, 0);
-			offscreenFramebuffer.Bind();
-		
-			Window::GetInstance()->Clear();
-			registry->view<Transform, MeshRenderer>().each([&depthShader](auto& transform, auto& meshRenderer)
+			const ShadowBatch& batch = shadowBatches[b];
+			Shader* depthShader = depthShaders[batch.bonePalette ? 1 : 0].get();
+
+			if (depthShader != activeShader)
 			{
-				if (!meshRenderer.castsShadows)
-					return;
+				depthShader->Use();
+				activeShader = depthShader;
+			}
 
-				Matrix4x4 model = Matrix4x4::Transformation(transform);
-				depthShader->SetMatrix4x4("model", model);
-				meshRenderer.mesh->Render(depthShader, 0.01f);
-			});
-		}
+			depthShader->SetInt(depthShader->GetUniformHandle(EngineUniforms::instanceOffset), batch.firstInstance);
 
-		Framebuffer::Unbind();
-		Window::GetInstance()->ResetDimensions();
-		Window::GetInstance()->Clear();
+			if (batch.bonePalette)
+				batch.bonePalette->Bind(BONE_PALETTE_BINDING);
 
-		pointLightIndex++;
-	});
+			batch.mesh->RenderInstanced(batch.instanceCount, batch.lod);
+
+			shadowDrawCalls++;
+		}
+	}
+
+	shadowDrawsSaved += (int)shadowCasters.size() * 6 - (shadowDraws - drawsBeforeLight);
 }
 
-void ShadowSettings::Update(std::shared_ptr<Camera> camera, Matrix4x4& view)
+void ShadowSettings::Update()
 {
-	//TempDirectionalLight(camera, view);
-	//TempPointLight(camera, view);
-	RenderPointLightShadows(camera, view);
+	// The views of this frame render after the shadows, so the ranking uses those of the last frame.
+	// With no view rendered since, nothing needs the maps and they keep their last state.
+	rankedViews.swap(views);
+	views.clear();
+
+	if (rankedViews.empty())
+		return;
+
+	RenderPointLightShadows();
 }
 
 void ShadowSettings::Bind(std::shared_ptr<Shader> shader)
@@ -6,23 +6,101 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Cubemap.hpp"
-#include "CubemapArray.hpp"
+#include "Bounds.hpp"
+#include "InstanceBuffer.hpp"
+#include "Framebuffer.hpp"
+#include "ShadowAtlas.hpp"
+#include "SSBO.hpp"
+
+#include <unordered_map>
 
 class Mesh;
 class Skybox;
+class UBO;
+
+struct ShadowCaster
+{
+	entt::entity entity;
+	Mesh* mesh;
+	const UBO* bonePalette;
+	Matrix4x4 model;
+	Bounds worldBounds;
+	int lod;
+};
+
+struct ShadowBatch
+{
+	Mesh* mesh;
+	const UBO* bonePalette;
+	int lod;
+	int firstInstance;
+	int instanceCount;
+};
+
+// A caster as it was last frame, to tell which shadow maps it has invalidated since
+struct CachedShadowCaster
+{
+	Mesh* mesh;
+	Matrix4x4 model;
+	Bounds worldBounds;
+};
+
+// A light as its shadow map was last rendered; the map is reused while the light, its tiles and the casters around it stay put
+struct CachedShadowMap
+{
+	Vector3 position;
+	float radius;
+	PointShadowGLSL shadow;
+};
 
 class ShadowSettings
 {
 public:
 	ShadowSettings(std::shared_ptr<entt::registry> registry);
-	void Update(std::shared_ptr<Camera> camera, Matrix4x4& view);
+
+	// Runs once per frame, before any view renders, so every view shares one set of shadow maps and the cache
+	// only sees each frame once. Lights are ranked by their largest size in the views added since the last Update.
+	void Update();
+	void AddView(const Vector3& cameraPosition, float pixelsPerUnit);
 	void Bind(std::shared_ptr<Shader> shader);
 private:
 	std::shared_ptr<entt::registry> registry;
 	Matrix4x4 lightSpaceMatrix;
 	Texture* shadowMap;
-	void TempDirectionalLight(std::shared_ptr<Camera> camera, Matrix4x4& view);
-	void RenderPointLightShadows(std::shared_ptr<Camera> camera, Matrix4x4& view);
+	void RenderPointLightShadows();
+	void GatherShadowCasters();
+	void FindChangedCasters();
+	bool IsTouchedByChangedCaster(const Vector3& position, float radius) const;
+	void RenderPointLightShadow(const ShadowRequest& request);
+	std::vector<ShadowCaster> shadowCasters;
+	std::vector<ShadowCaster*> lightCasters;
+	std::vector<ShadowBatch> shadowBatches;
+	std::vector<Matrix4x4> instanceModels;
+	InstanceBuffer instanceBuffer;
+	std::unordered_map<entt::entity, CachedShadowCaster> cachedCasters;
+	std::unordered_map<entt::entity, CachedShadowCaster> currentCasters;
+	std::vector<Bounds> changedBounds;
+	std::unordered_map<entt::entity, CachedShadowMap> cachedShadowMaps;
+	std::unordered_map<entt::entity, CachedShadowMap> currentShadowMaps;
+	// Level of detail each caster was last rendered at into each light's map, so casters near a threshold do not switch
+	// every time a map is rendered again
+	std::unordered_map<entt::entity, std::unordered_map<entt::entity, int>> shadowLods;
+	std::unordered_map<entt::entity, int> currentShadowLods;
+	std::vector<ShadowRequest> shadowRequests;
+
+	// A camera that rendered the scene, and how many pixels a unit at distance one covers in its view
+	struct ShadowView
+	{
+		Vector3 position;
+		float pixelsPerUnit;
+	};
+
+	std::vector<ShadowView> views;
+	std::vector<ShadowView> rankedViews;
+	std::vector<PointShadowGLSL> pointShadows;
+	std::vector<PointShadowGLSL> uploadedPointShadows;
+	SSBO pointShadowSSBO;
+	Framebuffer atlasFramebuffer;
 
 	//
 public:
@@ -30,5 +108,10 @@ public:
 	Shader* cubeShader;
 	Skybox* skybox;
 	std::unique_ptr<Cubemap> shadowCubeMap;
-	std::unique_ptr<CubemapArray> shadowCubeMapArray;
+	std::unique_ptr<ShadowAtlas> shadowAtlas;
+	int shadowDraws = 0;
+	int shadowDrawsSaved = 0;
+	int shadowDrawCalls = 0;
+	int shadowMapsRendered = 0;
+	int shadowMapsCached = 0;
 };
\ No newline at end of file
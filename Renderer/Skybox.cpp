@@ -52,12 +52,11 @@ Skybox::Skybox(std::string filePath)
 	Window::GetInstance()->ResetDimensions();
 }
 
-void Skybox::Render(const Matrix4x4& projection, const Matrix4x4& view)
+void Skybox::Render()
 {
+	// Projection and view come from the ViewData block of the current view
 	auto skyboxShader = ResourceManager::GetInstance()->GetShader("Resources/Engine/Shaders/Skybox.shader");
 	skyboxShader->Use();
-	skyboxShader->SetMatrix4x4("projection", projection);
-	skyboxShader->SetMatrix4x4("view", view);
 	environmentCubemap->Bind(skyboxShader->GetTextureUnit("environmentMap"));
 	ResourceManager::GetInstance()->GetMesh("Resources/Engine/Meshes/InvertedCube.obj")->Render();
 }
\ No newline at end of file
@@ -10,6 +10,6 @@ class Skybox
 {
 public:
 	Skybox(std::string filePath);
-	void Render(const Matrix4x4& projection, const Matrix4x4& view);
+	void Render();
 	std::shared_ptr<Cubemap> environmentCubemap;
 };
\ No newline at end of file
@@ -1,6 +1,69 @@
 #include "Texture.hpp"
+#include "TextureCompressor.hpp"
 #include "../Vendor/stb/stb_image.h"
+#include "../Core/MappedFile.hpp"
+#include "../Core/BinaryStream.hpp"
+#include "../Core/Hash.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// S3TC is an extension rather than core, so the loader may not define its formats
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Cooked textures are named after their source and keyed by its contents
+static const uint32_t kCookedTextureMagic = 0x54595344;
+static const uint32_t kCookedTextureVersion = 1;
+static const char* const s_CookedTextureFolder = "Cooked/Textures/";
+
+// Streamed textures start with the mips no larger than this and the TextureStreamer brings in the rest
+static const int s_StreamingStartSize = 64;
+
+// UVs usually tile or stretch across a mesh, so one level finer than its screen size suggests is asked for
+static const int s_StreamingMipBias = 1;
+
+bool Texture::useCompression = true;
+
+static uint64_t CalculateCookKey(const std::string& filePath)
+{
+	MappedFile source(filePath);
+
+	if (!source.IsOpen())
+		return 0;
+
+	uint64_t key = HashBytes(source.GetData(), source.GetSize());
+	key = HashBytes(&kCookedTextureVersion, sizeof(kCookedTextureVersion), key);
+	return key;
+}
+
+static std::string GetCookedPath(const std::string& filePath)
+{
+	std::string name = filePath;
+
+	for (char& c : name)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+
+	return s_CookedTextureFolder + name + ".tex";
+}
+
+static int StreamingStartMip(const std::vector<TextureMip>& mips)
+{
+	int mip = 0;
+
+	while (mip + 1 < (int)mips.size() && std::max(mips[mip].width, mips[mip].height) > s_StreamingStartSize)
+		mip++;
+
+	return mip;
+}
 
 Texture::Texture(float width, float height, GLenum internalFormat, GLenum format, GLenum minMagFilter, GLenum textureWrap)
 {
@@ -19,63 +82,343 @@ void Texture::AddBorder(float r, float g, float b, float a)
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
 }
 
-Texture::Texture(std::string filePath)
+Texture::Texture()
 {
+	const uint8_t white[4] = { 255, 255, 255, 255 };
+
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+Texture::Texture(std::string filePath)
+{
+	glGenTextures(1, &textureID);
+
+	TextureData data;
+
+	if (Decode(filePath, data))
+		Upload(data);
+}
+
+bool Texture::Decode(const std::string& filePath, TextureData& data, bool streamed)
+{
+	if (!useCompression)
+		return DecodeSource(filePath, data);
+
+	uint64_t cookKey = CalculateCookKey(filePath);
+	std::string cookedPath = GetCookedPath(filePath);
+
+	if (cookKey != 0 && LoadCooked(cookedPath, cookKey, data, streamed ? -1 : 0))
+		return true;
+
+	if (!DecodeSource(filePath, data))
+		return false;
+
+	if (!Compress(data) || cookKey == 0 || !WriteCooked(cookedPath, cookKey, data))
+		return true;
 
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
+	data.cookedPath = cookedPath;
+	data.cookKey = cookKey;
 
-	if (filePath.substr(filePath.length() - 4, filePath.length() - 1) == ".hdr")
+	// The larger mips of a freshly cooked streamed texture are dropped; they are read back from the cooked file when needed
+	if (streamed)
 	{
-		float* data = stbi_loadf(filePath.c_str(), &width, &height, &nrChannels, 0);
+		data.firstMip = StreamingStartMip(data.mips);
+		data.pixels.erase(data.pixels.begin(), data.pixels.begin() + (size_t)data.mips[data.firstMip].offset);
+	}
 
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return true;
+}
 
-			stbi_image_free(data);
-		}
+bool Texture::DecodeSource(const std::string& filePath, TextureData& data)
+{
+	// The flip flag is per thread so decodes on different workers do not interfere
+	stbi_set_flip_vertically_on_load_thread(true);
+
+	data.isHdr = filePath.length() >= 4 && filePath.substr(filePath.length() - 4) == ".hdr";
+	void* pixels;
+
+	if (data.isHdr)
+		pixels = stbi_loadf(filePath.c_str(), &data.width, &data.height, &data.channels, 0);
+	else
+		pixels = stbi_load(filePath.c_str(), &data.width, &data.height, &data.channels, 0);
+
+	if (!pixels)
+	{
+		std::cout << "Failed to load texture" << std::endl;
+		return false;
+	}
+
+	size_t size = (size_t)data.width * data.height * data.channels * (data.isHdr ? sizeof(float) : 1);
+	data.pixels.assign((const uint8_t*)pixels, (const uint8_t*)pixels + size);
+	stbi_image_free(pixels);
+	return true;
+}
+
+bool Texture::Compress(TextureData& data)
+{
+	// HDR images are only sampled at full size when converted to cubemaps, so they keep a single level
+	if (data.isHdr)
+	{
+		if (data.channels != 3)
+			return false;
+
+		std::vector<uint8_t> blocks;
+		TextureCompressor::CompressBC6H((const float*)data.pixels.data(), data.width, data.height, blocks);
+
+		data.compressedFormat = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		data.mips.push_back({ data.width, data.height, 0, blocks.size() });
+		data.pixels.swap(blocks);
+		return true;
+	}
+
+	bool opaque = true;
+
+	if (data.channels == 4)
+	{
+		for (size_t i = 3; i < data.pixels.size() && opaque; i += 4)
+			opaque = data.pixels[i] == 255;
+	}
+
+	if (data.channels == 1)
+		data.compressedFormat = GL_COMPRESSED_RED_RGTC1;
+	else if (data.channels == 2)
+		data.compressedFormat = GL_COMPRESSED_RG_RGTC2;
+	else if (data.channels == 3 || opaque)
+		data.compressedFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else
+		data.compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	std::vector<uint8_t> level = std::move(data.pixels);
+	std::vector<uint8_t> nextLevel;
+	std::vector<uint8_t> blocks;
+	int width = data.width;
+	int height = data.height;
+
+	data.pixels.clear();
+
+	while (true)
+	{
+		if (data.compressedFormat == GL_COMPRESSED_RED_RGTC1)
+			TextureCompressor::CompressBC4(level.data(), width, height, 1, blocks);
+		else if (data.compressedFormat == GL_COMPRESSED_RG_RGTC2)
+			TextureCompressor::CompressBC5(level.data(), width, height, blocks);
+		else if (data.compressedFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+			TextureCompressor::CompressBC1(level.data(), width, height, data.channels, blocks);
 		else
+			TextureCompressor::CompressBC3(level.data(), width, height, blocks);
+
+		data.mips.push_back({ width, height, data.pixels.size(), blocks.size() });
+		data.pixels.insert(data.pixels.end(), blocks.begin(), blocks.end());
+
+		if (width == 1 && height == 1)
+			break;
+
+		TextureCompressor::Downsample(level.data(), width, height, data.channels, nextLevel);
+		level.swap(nextLevel);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	return true;
+}
+
+// A negative firstMip starts at the first level small enough to begin streaming from
+bool Texture::LoadCooked(const std::string& cookedPath, uint64_t cookKey, TextureData& data, int firstMip)
+{
+	MappedFile file(cookedPath);
+
+	if (!file.IsOpen())
+		return false;
+
+	BinaryReader reader(file.GetData(), file.GetSize());
+
+	if (reader.Read<uint32_t>() != kCookedTextureMagic || reader.Read<uint64_t>() != cookKey)
+		return false;
+
+	data.width = reader.Read<int32_t>();
+	data.height = reader.Read<int32_t>();
+	data.channels = reader.Read<int32_t>();
+	data.isHdr = reader.Read<uint8_t>() != 0;
+	data.compressedFormat = reader.Read<uint32_t>();
+	reader.ReadVector(data.mips);
+
+	uint64_t pixelsSize = reader.Read<uint64_t>();
+	const uint8_t* pixels = reader.ReadBytes((size_t)pixelsSize);
+
+	bool valid = reader.IsValid() && reader.Read<uint32_t>() == kCookedTextureMagic && !data.mips.empty();
+
+	for (const TextureMip& mip : data.mips)
+		valid = valid && mip.offset <= pixelsSize && mip.size <= pixelsSize - mip.offset;
+
+	if (!valid)
+	{
+		std::cout << "Cooked texture " << cookedPath << " is corrupt, cooking it again" << std::endl;
+		data = TextureData();
+		return false;
+	}
+
+	// Mips are stored largest first, so the levels from firstMip down are one run at the end of the file
+	data.firstMip = firstMip < 0 ? StreamingStartMip(data.mips) : std::min(firstMip, (int)data.mips.size() - 1);
+	data.pixels.assign(pixels + data.mips[data.firstMip].offset, pixels + pixelsSize);
+	data.cookedPath = cookedPath;
+	data.cookKey = cookKey;
+	return true;
+}
+
+bool Texture::WriteCooked(const std::string& cookedPath, uint64_t cookKey, const TextureData& data)
+{
+	BinaryWriter writer;
+	writer.Write(kCookedTextureMagic);
+	writer.Write(cookKey);
+	writer.Write((int32_t)data.width);
+	writer.Write((int32_t)data.height);
+	writer.Write((int32_t)data.channels);
+	writer.Write((uint8_t)data.isHdr);
+	writer.Write((uint32_t)data.compressedFormat);
+	writer.WriteVector(data.mips);
+	writer.WriteVector(data.pixels);
+
+	// A trailing magic catches files cut short while writing
+	writer.Write(kCookedTextureMagic);
+
+	if (!writer.WriteToFile(cookedPath))
+	{
+		std::cout << "Could not write cooked texture " << cookedPath << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Texture::Upload(const TextureData& data)
+{
+	// Streamed textures live in immutable storage sized to their resident mips, built by SetResidentMip
+	if (data.firstMip > 0)
+	{
+		streamedMips = data.mips;
+		streamedFormat = data.compressedFormat;
+		cookedPath = data.cookedPath;
+		cookKey = data.cookKey;
+		residentMip = (int)data.mips.size();
+		SetResidentMip(data.firstMip, data);
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	if (data.compressedFormat != 0)
+	{
+		for (size_t level = 0; level < data.mips.size(); level++)
 		{
-			std::cout << "Failed to load texture" << std::endl;
+			const TextureMip& mip = data.mips[level];
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, data.compressedFormat, mip.width, mip.height, 0, (GLsizei)mip.size, data.pixels.data() + mip.offset);
 		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)data.mips.size() - 1);
+	}
+
+	if (data.isHdr)
+	{
+		if (data.compressedFormat == 0)
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, data.width, data.height, 0, GL_RGB, GL_FLOAT, data.pixels.data());
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	}
 	else
 	{
-		unsigned char* data = stbi_load(filePath.c_str(), &width, &height, &nrChannels, 0);
+		GLenum colorSpace;
+		if (data.channels == 1)
+			colorSpace = GL_RED;
+		else if (data.channels == 2)
+			colorSpace = GL_RG;
+		else if (data.channels == 3)
+			colorSpace = GL_RGB;
+		else
+			colorSpace = GL_RGBA;
 
-		if (data)
+		if (data.compressedFormat == 0)
 		{
-			GLenum colorSpace;
-			if (nrChannels == 1)
-				colorSpace = GL_RED;
-			else if (nrChannels == 2)
-				colorSpace = GL_RG;
-			else if (nrChannels == 3)
-				colorSpace = GL_RGB;
-			else
-				colorSpace = GL_RGBA;
-
-			glTexImage2D(GL_TEXTURE_2D, 0, colorSpace, width, height, 0, colorSpace, GL_UNSIGNED_BYTE, data);
+			glTexImage2D(GL_TEXTURE_2D, 0, colorSpace, data.width, data.height, 0, colorSpace, GL_UNSIGNED_BYTE, data.pixels.data());
 			glGenerateMipmap(GL_TEXTURE_2D);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
 
-			stbi_image_free(data);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+}
+
+int Texture::GetMipForSize(float pixels) const
+{
+	if (streamedMips.empty())
+		return 0;
+
+	float size = (float)std::max(streamedMips[0].width, streamedMips[0].height);
+	int mip = (int)floorf(log2f(size / std::max(pixels, 1.0f))) - s_StreamingMipBias;
+	return std::min(std::max(mip, 0), (int)streamedMips.size() - 1);
+}
+
+size_t Texture::GetMipsSize(int firstMip) const
+{
+	size_t size = 0;
+
+	for (int mip = std::max(firstMip, 0); mip < (int)streamedMips.size(); mip++)
+		size += (size_t)streamedMips[mip].size;
+
+	return size;
+}
+
+bool Texture::DecodeMips(int firstMip, TextureData& data) const
+{
+	return LoadCooked(cookedPath, cookKey, data, firstMip) && data.mips.size() == streamedMips.size();
+}
+
+void Texture::SetResidentMip(int firstMip, const TextureData& data)
+{
+	int mipCount = (int)streamedMips.size();
+	firstMip = std::min(std::max(firstMip, 0), mipCount - 1);
+
+	if (firstMip == residentMip || (firstMip < residentMip && (data.mips.empty() || firstMip < data.firstMip)))
+		return;
+
+	// Mutable textures cannot reliably give memory back, so the resident range is moved into a new texture
+	unsigned int newTextureID;
+	glGenTextures(1, &newTextureID);
+	glBindTexture(GL_TEXTURE_2D, newTextureID);
+	glTexStorage2D(GL_TEXTURE_2D, mipCount - firstMip, streamedFormat, streamedMips[firstMip].width, streamedMips[firstMip].height);
+
+	for (int mip = firstMip; mip < mipCount; mip++)
+	{
+		const TextureMip& level = streamedMips[mip];
+
+		if (mip >= residentMip)
+		{
+			glCopyImageSubData(textureID, GL_TEXTURE_2D, mip - residentMip, 0, 0, 0, newTextureID, GL_TEXTURE_2D, mip - firstMip, 0, 0, 0, level.width, level.height, 1);
 		}
 		else
 		{
-			std::cout << "Failed to load texture" << std::endl;
+			const uint8_t* pixels = data.pixels.data() + (level.offset - data.mips[data.firstMip].offset);
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, mip - firstMip, 0, 0, level.width, level.height, streamedFormat, (GLsizei)level.size, pixels);
 		}
 	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glDeleteTextures(1, &textureID);
+	textureID = newTextureID;
+	residentMip = firstMip;
 }
 
 unsigned int Texture::GetTextureID()
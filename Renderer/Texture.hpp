@@ -2,16 +2,78 @@
 
 #include <glad/glad.h>
 #include <string>
+#include <vector>
+#include <cstdint>
+
+// One level of a cooked mip chain, stored at offset in TextureData::pixels
+struct TextureMip
+{
+	int width;
+	int height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// Pixels decoded by Texture::Decode, waiting for Texture::Upload on the GL thread
+struct TextureData
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	bool isHdr = false;
+	std::vector<uint8_t> pixels;
+
+	// Set when pixels hold a block compressed mip chain rather than a single uncompressed image
+	GLenum compressedFormat = 0;
+	std::vector<TextureMip> mips;
+
+	// Levels before firstMip were left in the cooked file; pixels start at mips[firstMip]
+	int firstMip = 0;
+	std::string cookedPath;
+	uint64_t cookKey = 0;
+};
 
 class Texture
 {
 public:
+	// A 1x1 white texture; ResourceManager hands these out while the real image decodes
+	Texture();
 	Texture(float width, float height, GLenum internalFormat, GLenum format, GLenum minMagFilter = GL_LINEAR, GLenum textureWrap = GL_CLAMP_TO_EDGE);
 	Texture(std::string filePath);
+
+	// Decode makes no GL calls and can run on any thread; Upload replaces the image of this texture in place.
+	// A streamed decode only reads the small mips of a cooked texture and the TextureStreamer loads the rest on demand.
+	static bool Decode(const std::string& filePath, TextureData& data, bool streamed = false);
+	void Upload(const TextureData& data);
+
+	// Level 0 of a streamed texture's GL storage is mip GetResidentMip() of the full chain
+	bool IsStreamed() const { return !streamedMips.empty(); }
+	int GetMipCount() const { return (int)streamedMips.size(); }
+	int GetResidentMip() const { return residentMip; }
+	int GetMipForSize(float pixels) const;
+	size_t GetMipsSize(int firstMip) const;
+	bool DecodeMips(int firstMip, TextureData& data) const;
+	// Reallocates the texture holding mips from firstMip down; data must hold any levels that are not resident yet
+	void SetResidentMip(int firstMip, const TextureData& data);
+
 	void Bind(int textureUnit);
 	unsigned int GetTextureID();
 	void AddBorder(float r, float g, float b, float a);
 	void Reformat(float width, float height, GLenum internalFormat, GLenum format, GLenum minMagFilter = GL_LINEAR, GLenum textureWrap = GL_CLAMP_TO_EDGE);
+
+	// Textures decoded from now on are cooked to block compressed mip chains; off uploads the source image as before
+	static bool useCompression;
 private:
+	static bool DecodeSource(const std::string& filePath, TextureData& data);
+	static bool Compress(TextureData& data);
+	static bool LoadCooked(const std::string& cookedPath, uint64_t cookKey, TextureData& data, int firstMip);
+	static bool WriteCooked(const std::string& cookedPath, uint64_t cookKey, const TextureData& data);
+
 	unsigned int textureID;
+
+	std::vector<TextureMip> streamedMips;
+	GLenum streamedFormat = 0;
+	std::string cookedPath;
+	uint64_t cookKey = 0;
+	int residentMip = 0;
 };
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include "TextureCompressor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Interpolation weights of BC6H's 4 bit indices, out of 64
+static const int kBC6HWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+template<typename T>
+static void FetchBlock(const T* pixels, int width, int height, int channels, int blockX, int blockY, T block[16][4], T fill)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			int sourceX = std::min(blockX * 4 + x, width - 1);
+			int sourceY = std::min(blockY * 4 + y, height - 1);
+			const T* source = pixels + ((size_t)sourceY * width + sourceX) * channels;
+
+			for (int c = 0; c < 4; c++)
+				block[y * 4 + x][c] = c < channels ? source[c] : fill;
+		}
+	}
+}
+
+// Largest eigenvector of the block's colour covariance, found by power iteration
+static void PrincipalAxis(const float colors[16][3], float axis[3])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			mean[c] += colors[i][c] / 16.0f;
+	}
+
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++)
+	{
+		float r = colors[i][0] - mean[0];
+		float g = colors[i][1] - mean[1];
+		float b = colors[i][2] - mean[2];
+
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+
+	axis[0] = 1.0f;
+	axis[1] = 1.0f;
+	axis[2] = 1.0f;
+
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+
+		// A flat block has no axis; any direction gives the same endpoints
+		if (length <= 0.0f)
+			return;
+
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+}
+
+// Indices of the pixels at either end of the block's principal axis
+static void AxisExtremes(const float colors[16][3], int& minimum, int& maximum)
+{
+	float axis[3];
+	PrincipalAxis(colors, axis);
+
+	float minimumProjection = 0.0f;
+	float maximumProjection = 0.0f;
+	minimum = 0;
+	maximum = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+
+		if (i == 0 || projection < minimumProjection)
+		{
+			minimumProjection = projection;
+			minimum = i;
+		}
+
+		if (i == 0 || projection > maximumProjection)
+		{
+			maximumProjection = projection;
+			maximum = i;
+		}
+	}
+}
+
+static uint16_t PackRGB565(const float color[3])
+{
+	int r = (int)std::min(std::max(roundf(color[0] * 31.0f / 255.0f), 0.0f), 31.0f);
+	int g = (int)std::min(std::max(roundf(color[1] * 63.0f / 255.0f), 0.0f), 63.0f);
+	int b = (int)std::min(std::max(roundf(color[2] * 31.0f / 255.0f), 0.0f), 31.0f);
+	return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void UnpackRGB565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+
+	color[0] = r << 3 | r >> 2;
+	color[1] = g << 2 | g >> 4;
+	color[2] = b << 3 | b >> 2;
+}
+
+static void CompressColorBlock(const uint8_t block[16][4], uint8_t* output)
+{
+	float colors[16][3];
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			colors[i][c] = block[i][c];
+	}
+
+	int minimum, maximum;
+	AxisExtremes(colors, minimum, maximum);
+
+	// Pulling the endpoints in by a sixteenth of the range gives the interpolated colours a fairer share of the pixels
+	float endpoints[2][3];
+
+	for (int c = 0; c < 3; c++)
+	{
+		float inset = (colors[maximum][c] - colors[minimum][c]) / 16.0f;
+		endpoints[0][c] = colors[maximum][c] - inset;
+		endpoints[1][c] = colors[minimum][c] + inset;
+	}
+
+	uint16_t color0 = PackRGB565(endpoints[0]);
+	uint16_t color1 = PackRGB565(endpoints[1]);
+
+	// The first endpoint must be the larger one, or the block switches to the three colour mode with transparency
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint32_t indices = 0;
+
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = 0;
+
+			for (int p = 0; p < 4; p++)
+			{
+				int error = 0;
+
+				for (int c = 0; c < 3; c++)
+					error += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+
+				if (p == 0 || error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+
+			indices |= (uint32_t)bestIndex << (i * 2);
+		}
+	}
+
+	memcpy(output, &color0, 2);
+	memcpy(output + 2, &color1, 2);
+	memcpy(output + 4, &indices, 4);
+}
+
+static void CompressChannelBlock(const uint8_t block[16][4], int channel, uint8_t* output)
+{
+	int minimum = 255;
+	int maximum = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		minimum = std::min(minimum, (int)block[i][channel]);
+		maximum = std::max(maximum, (int)block[i][channel]);
+	}
+
+	// With the first endpoint larger the block uses eight interpolated values; a flat block leaves every index at zero
+	uint64_t bits = (uint64_t)maximum | (uint64_t)minimum << 8;
+
+	if (maximum != minimum)
+	{
+		int palette[8];
+		palette[0] = maximum;
+		palette[1] = minimum;
+
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * maximum + (p - 1) * minimum) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = 256;
+
+			for (int p = 0; p < 8; p++)
+			{
+				int error = abs(block[i][channel] - palette[p]);
+
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+
+			bits |= (uint64_t)bestIndex << (16 + i * 3);
+		}
+	}
+
+	memcpy(output, &bits, 8);
+}
+
+static uint16_t FloatToUnsignedHalf(float value)
+{
+	// Negative values and NaNs cannot be stored in the unsigned format, and infinities clamp to the largest half
+	if (!(value > 0.0f))
+		return 0;
+
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0)
+		return 0;
+
+	if (exponent >= 31)
+		return 0x7BFF;
+
+	uint32_t half = ((uint32_t)exponent << 10 | mantissa >> 13) + ((mantissa >> 12) & 1);
+	return (uint16_t)std::min(half, (uint32_t)0x7BFF);
+}
+
+// The 16 bit value a 10 bit unsigned endpoint expands to before interpolation
+static int UnquantizeBC6HEndpoint(int quantized)
+{
+	int unquantized;
+
+	if (quantized == 0)
+		unquantized = 0;
+	else if (quantized == 1023)
+		unquantized = 0xFFFF;
+	else
+		unquantized = ((quantized << 16) + 0x8000) >> 10;
+
+	return unquantized;
+}
+
+static int FinishBC6H(int unquantized)
+{
+	return (unquantized * 31) >> 6;
+}
+
+static int QuantizeBC6HEndpoint(float half)
+{
+	// Search around the inverse of the decode for the code whose result lands closest
+	int estimate = (int)(half / 31.0f);
+	int best = 0;
+	float bestError = 0.0f;
+
+	for (int candidate = std::max(estimate - 1, 0); candidate <= std::min(estimate + 1, 1023); candidate++)
+	{
+		float error = fabsf((float)FinishBC6H(UnquantizeBC6HEndpoint(candidate)) - half);
+
+		if (candidate == std::max(estimate - 1, 0) || error < bestError)
+		{
+			bestError = error;
+			best = candidate;
+		}
+	}
+
+	return best;
+}
+
+static void WriteBits(uint64_t bits[2], int& position, uint64_t value, int count)
+{
+	for (int i = 0; i < count; i++, position++)
+	{
+		if ((value >> i) & 1)
+			bits[position / 64] |= 1ull << (position % 64);
+	}
+}
+
+static void CompressHdrBlock(const float block[16][4], uint8_t* output)
+{
+	// Endpoints and errors are worked out on the half float bit patterns, which are close to logarithmic in brightness
+	float halves[16][3];
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			halves[i][c] = FloatToUnsignedHalf(block[i][c]);
+	}
+
+	int minimum, maximum;
+	AxisExtremes(halves, minimum, maximum);
+
+	int endpoints[2][3];
+	int palette[16][3];
+
+	for (int c = 0; c < 3; c++)
+	{
+		endpoints[0][c] = QuantizeBC6HEndpoint(halves[minimum][c]);
+		endpoints[1][c] = QuantizeBC6HEndpoint(halves[maximum][c]);
+
+		int first = UnquantizeBC6HEndpoint(endpoints[0][c]);
+		int second = UnquantizeBC6HEndpoint(endpoints[1][c]);
+
+		for (int p = 0; p < 16; p++)
+			palette[p][c] = FinishBC6H(((64 - kBC6HWeights[p]) * first + kBC6HWeights[p] * second + 32) >> 6);
+	}
+
+	int indices[16];
+
+	for (int i = 0; i < 16; i++)
+	{
+		float bestError = 0.0f;
+		indices[i] = 0;
+
+		for (int p = 0; p < 16; p++)
+		{
+			float error = 0.0f;
+
+			for (int c = 0; c < 3; c++)
+				error += (halves[i][c] - palette[p][c]) * (halves[i][c] - palette[p][c]);
+
+			if (p == 0 || error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+	}
+
+	// The first pixel's index is stored without its top bit, so the endpoints are swapped if it would need it
+	if (indices[0] >= 8)
+	{
+		for (int c = 0; c < 3; c++)
+			std::swap(endpoints[0][c], endpoints[1][c]);
+
+		for (int i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	uint64_t bits[2] = { 0, 0 };
+	int position = 0;
+
+	WriteBits(bits, position, 0x03, 5);
+
+	for (int e = 0; e < 2; e++)
+	{
+		for (int c = 0; c < 3; c++)
+			WriteBits(bits, position, endpoints[e][c], 10);
+	}
+
+	for (int i = 0; i < 16; i++)
+		WriteBits(bits, position, indices[i], i == 0 ? 3 : 4);
+
+	memcpy(output, bits, 16);
+}
+
+void TextureCompressor::Downsample(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result)
+{
+	int resultWidth = std::max(width / 2, 1);
+	int resultHeight = std::max(height / 2, 1);
+	result.resize((size_t)resultWidth * resultHeight * channels);
+
+	for (int y = 0; y < resultHeight; y++)
+	{
+		int y0 = std::min(y * 2, height - 1);
+		int y1 = std::min(y * 2 + 1, height - 1);
+
+		for (int x = 0; x < resultWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1);
+			int x1 = std::min(x * 2 + 1, width - 1);
+
+			for (int c = 0; c < channels; c++)
+			{
+				int sum = pixels[((size_t)y0 * width + x0) * channels + c] + pixels[((size_t)y0 * width + x1) * channels + c]
+					+ pixels[((size_t)y1 * width + x0) * channels + c] + pixels[((size_t)y1 * width + x1) * channels + c];
+
+				result[((size_t)y * resultWidth + x) * channels + c] = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+size_t TextureCompressor::CompressedSize(int width, int height, int blockBytes)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+void TextureCompressor::CompressBC1(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result)
+{
+	result.resize(CompressedSize(width, height, 8));
+	uint8_t* output = result.data();
+	uint8_t block[16][4];
+
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++, output += 8)
+		{
+			FetchBlock(pixels, width, height, channels, blockX, blockY, block, (uint8_t)255);
+			CompressColorBlock(block, output);
+		}
+	}
+}
+
+void TextureCompressor::CompressBC3(const uint8_t* pixels, int width, int height, std::vector<uint8_t>& result)
+{
+	result.resize(CompressedSize(width, height, 16));
+	uint8_t* output = result.data();
+	uint8_t block[16][4];
+
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++, output += 16)
+		{
+			FetchBlock(pixels, width, height, 4, blockX, blockY, block, (uint8_t)255);
+			CompressChannelBlock(block, 3, output);
+			CompressColorBlock(block, output + 8);
+		}
+	}
+}
+
+void TextureCompressor::CompressBC4(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result)
+{
+	result.resize(CompressedSize(width, height, 8));
+	uint8_t* output = result.data();
+	uint8_t block[16][4];
+
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++, output += 8)
+		{
+			FetchBlock(pixels, width, height, channels, blockX, blockY, block, (uint8_t)0);
+			CompressChannelBlock(block, 0, output);
+		}
+	}
+}
+
+void TextureCompressor::CompressBC5(const uint8_t* pixels, int width, int height, std::vector<uint8_t>& result)
+{
+	result.resize(CompressedSize(width, height, 16));
+	uint8_t* output = result.data();
+	uint8_t block[16][4];
+
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++, output += 16)
+		{
+			FetchBlock(pixels, width, height, 2, blockX, blockY, block, (uint8_t)0);
+			CompressChannelBlock(block, 0, output);
+			CompressChannelBlock(block, 1, output + 8);
+		}
+	}
+}
+
+void TextureCompressor::CompressBC6H(const float* pixels, int width, int height, std::vector<uint8_t>& result)
+{
+	result.resize(CompressedSize(width, height, 16));
+	uint8_t* output = result.data();
+	float block[16][4];
+
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++, output += 16)
+		{
+			FetchBlock(pixels, width, height, 3, blockX, blockY, block, 0.0f);
+			CompressHdrBlock(block, output);
+		}
+	}
+}
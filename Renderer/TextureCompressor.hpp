@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Mip generation and block compression used when cooking textures. Images are tightly packed rows of
+// 8 bit channels, or RGB floats for HDR; sizes that are not a multiple of four are padded by repeating the edge pixels.
+class TextureCompressor
+{
+public:
+	// Box filters one level down; odd sizes round down and never go below 1x1
+	static void Downsample(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result);
+
+	// Bytes taken by a compressed level with blocks of the given size
+	static size_t CompressedSize(int width, int height, int blockBytes);
+
+	// BC1 from RGB or RGBA (alpha ignored), BC3 from RGBA, BC4 from one channel, BC5 from two
+	static void CompressBC1(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result);
+	static void CompressBC3(const uint8_t* pixels, int width, int height, std::vector<uint8_t>& result);
+	static void CompressBC4(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& result);
+	static void CompressBC5(const uint8_t* pixels, int width, int height, std::vector<uint8_t>& result);
+
+	// BC6H unsigned from RGB floats, using the single region mode with 10 bit endpoints
+	static void CompressBC6H(const float* pixels, int width, int height, std::vector<uint8_t>& result);
+};
@@ -0,0 +1,144 @@
+#include "TextureStreamer.hpp"
+#include "../Core/ThreadPool.hpp"
+
+#include <algorithm>
+#include <limits>
+
+TextureStreamer* TextureStreamer::s_Instance;
+
+static const size_t s_DefaultStreamingBudget = 256 * 1024 * 1024;
+
+// Reads in flight at once; each one is a whole run of mips, so a few keep the workers busy without flooding the upload
+static const int s_MaxStreamingLoads = 4;
+
+static const int s_NoRequest = std::numeric_limits<int>::max();
+
+TextureStreamer::TextureStreamer() : budget(s_DefaultStreamingBudget)
+{
+	TextureStreamer::s_Instance = this;
+}
+
+TextureStreamer* TextureStreamer::GetInstance()
+{
+	return TextureStreamer::s_Instance;
+}
+
+void TextureStreamer::Register(std::shared_ptr<Texture> texture)
+{
+	if (!texture->IsStreamed() || textures.find(texture.get()) != textures.end())
+		return;
+
+	textures.emplace(texture.get(), StreamedTexture{ texture, texture->GetResidentMip(), s_NoRequest, frame, 0 });
+}
+
+void TextureStreamer::Request(Texture* texture, float pixels)
+{
+	auto found = textures.find(texture);
+
+	if (found == textures.end())
+		return;
+
+	StreamedTexture& streamed = found->second;
+	streamed.requestedMip = std::min(streamed.requestedMip, texture->GetMipForSize(pixels));
+	streamed.lastUsedFrame = frame;
+}
+
+void TextureStreamer::Update()
+{
+	std::vector<FinishedLoad> finished;
+
+	{
+		std::lock_guard<std::mutex> lock(finishedMutex);
+		finished.swap(finishedLoads);
+	}
+
+	for (FinishedLoad& load : finished)
+	{
+		StreamedTexture& streamed = textures[load.texture];
+		loadingSize -= streamed.loadingSize;
+		streamed.loadingSize = 0;
+		pendingLoads--;
+
+		if (load.data && load.data->firstMip < load.texture->GetResidentMip())
+			load.texture->SetResidentMip(load.data->firstMip, *load.data);
+	}
+
+	// Requests made while drawing the last frame decide what is wanted now
+	std::vector<StreamedTexture*> leastRecentlyUsed;
+	residentSize = 0;
+
+	for (auto& entry : textures)
+	{
+		leastRecentlyUsed.push_back(&entry.second);
+		residentSize += entry.second.texture->GetMipsSize(entry.second.texture->GetResidentMip());
+	}
+
+	std::sort(leastRecentlyUsed.begin(), leastRecentlyUsed.end(), [](const StreamedTexture* a, const StreamedTexture* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+
+	// Over budget, the largest mips of textures not drawn last frame go first, oldest first, down to what they started with
+	for (StreamedTexture* streamed : leastRecentlyUsed)
+	{
+		if (residentSize <= budget || streamed->lastUsedFrame == frame)
+			break;
+
+		Texture* texture = streamed->texture.get();
+
+		if (streamed->loadingSize > 0 || texture->GetResidentMip() >= streamed->minimumMip)
+			continue;
+
+		size_t residentMipsSize = texture->GetMipsSize(texture->GetResidentMip());
+		int keptMip = texture->GetResidentMip() + 1;
+
+		while (keptMip < streamed->minimumMip && residentSize - (residentMipsSize - texture->GetMipsSize(keptMip)) > budget)
+			keptMip++;
+
+		residentSize -= residentMipsSize - texture->GetMipsSize(keptMip);
+		texture->SetResidentMip(keptMip, TextureData());
+	}
+
+	// The most recently used textures load first, each as far as the budget allows
+	for (auto it = leastRecentlyUsed.rbegin(); it != leastRecentlyUsed.rend() && pendingLoads < s_MaxStreamingLoads; ++it)
+	{
+		StreamedTexture* streamed = *it;
+		Texture* texture = streamed->texture.get();
+		int wantedMip = streamed->requestedMip;
+
+		if (wantedMip == s_NoRequest || streamed->loadingSize > 0)
+			continue;
+
+		size_t residentMipsSize = texture->GetMipsSize(texture->GetResidentMip());
+
+		while (wantedMip < texture->GetResidentMip() && residentSize + loadingSize + texture->GetMipsSize(wantedMip) - residentMipsSize > budget)
+			wantedMip++;
+
+		if (wantedMip >= texture->GetResidentMip())
+			continue;
+
+		streamed->loadingSize = texture->GetMipsSize(wantedMip) - residentMipsSize;
+		loadingSize += streamed->loadingSize;
+		pendingLoads++;
+
+		std::shared_ptr<Texture> texturePointer = streamed->texture;
+		auto load = [this, texturePointer, wantedMip]()
+		{
+			std::shared_ptr<TextureData> data = std::make_shared<TextureData>();
+
+			if (!texturePointer->DecodeMips(wantedMip, *data))
+				data.reset();
+
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			finishedLoads.push_back({ texturePointer.get(), data });
+		};
+
+		if (ThreadPool::GetInstance() != nullptr)
+			ThreadPool::GetInstance()->Enqueue(load);
+		else
+			load();
+	}
+
+	// Textures not reached because too many loads were in flight ask again next frame
+	for (auto& entry : textures)
+		entry.second.requestedMip = s_NoRequest;
+
+	frame++;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Texture.hpp"
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+// Loads the larger mips of streamed textures as they are needed on screen and drops the largest mips of the least
+// recently used ones when the resident total goes over budget
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	static TextureStreamer* GetInstance();
+
+	void Register(std::shared_ptr<Texture> texture);
+
+	// Called while drawing with the height in pixels of what the texture is drawn on
+	void Request(Texture* texture, float pixels);
+
+	// Applies finished loads, evicts to stay under budget and starts new loads; runs on the GL thread once a frame
+	void Update();
+
+	void SetBudget(size_t bytes) { budget = bytes; }
+	size_t GetBudget() const { return budget; }
+	size_t GetResidentSize() const { return residentSize; }
+	int GetPendingLoadCount() const { return pendingLoads; }
+private:
+	struct StreamedTexture
+	{
+		std::shared_ptr<Texture> texture;
+		int minimumMip;
+		int requestedMip;
+		uint32_t lastUsedFrame;
+		size_t loadingSize;
+	};
+
+	struct FinishedLoad
+	{
+		Texture* texture;
+		std::shared_ptr<TextureData> data;
+	};
+
+	static TextureStreamer* s_Instance;
+	std::unordered_map<Texture*, StreamedTexture> textures;
+	std::mutex finishedMutex;
+	std::vector<FinishedLoad> finishedLoads;
+	size_t budget;
+	size_t residentSize = 0;
+	size_t loadingSize = 0;
+	int pendingLoads = 0;
+	uint32_t frame = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Owns its GL buffer; it can be moved, e.g. when entt relocates the component holding it, but not copied
+class UBO
+{
+public:
+	UBO() {};
+	UBO(const UBO&) = delete;
+	UBO& operator=(const UBO&) = delete;
+
+	UBO(UBO&& other) noexcept : initialized(other.initialized), ID(other.ID)
+	{
+		other.initialized = false;
+	};
+
+	UBO& operator=(UBO&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			initialized = other.initialized;
+			ID = other.ID;
+			other.initialized = false;
+		}
+
+		return *this;
+	};
+
+	~UBO()
+	{
+		Release();
+	};
+
+	template <class T>
+	void Initialize(int binding, size_t size, T* data)
+	{
+		glGenBuffers(1, &ID);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		initialized = true;
+	};
+
+	template <class T>
+	void Set(int binding, size_t size, T* data)
+	{
+		if (initialized == false)
+		{
+			Initialize(binding, size, data);
+			return;
+		}
+
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	};
+
+	void Bind(int binding) const
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+	};
+
+	bool initialized = false;
+private:
+	void Release()
+	{
+		if (initialized)
+			glDeleteBuffers(1, &ID);
+
+		initialized = false;
+	};
+
+	GLuint ID = 0;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../Core/Math/Matrix4x4.hpp"
+#include "../Core/Math/Vector4.hpp"
+#include "../Core/Math/Vector2.hpp"
+
+#include <cstdint>
+
+// Engine shaders declare "layout(std140) uniform ViewData" and are bound to this point when compiled
+static const int VIEW_DATA_BINDING = 0;
+static const char* const VIEW_DATA_BLOCK_NAME = "ViewData";
+
+struct ViewDataGLSL
+{
+	Matrix4x4 projection;
+	Matrix4x4 view;
+	Vector4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	Vector2 clusterScreenSpaceSize;
+	float ambientLighting;
+	float padding[1];
+	uint32_t clusterCounts[3];
+	float padding2[1];
+};
+
+static_assert(sizeof(ViewDataGLSL) == 192, "ViewDataGLSL must match the std140 layout of the ViewData block");
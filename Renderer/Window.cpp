@@ -10,15 +10,51 @@
 void FramebufferSizeCallback(GLFWwindow* p_window, int width, int height);
 Window* Window::s_Instance;
 
-Window::Window(const char* title, float width, float height)
+static void PrintHeadlessRequirements(bool headless)
 {
-	glfwInit();
+	if (!headless)
+		return;
+
+#ifdef GLFW_PLATFORM_NULL
+	std::cout << "Headless rendering needs GLFW built with OSMesa support for its null platform" << std::endl;
+#else
+	std::cout << "Headless rendering needs GLFW 3.4 or newer; older versions need a display, such as one from Xvfb" << std::endl;
+#endif
+}
+
+Window::Window(const char* title, float width, float height, bool headless)
+{
+	isOpen = false;
+	window = NULL;
+
+#ifdef GLFW_PLATFORM_NULL
+	// Without a display, the null platform with an OSMesa context renders in software (llvmpipe)
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+
+	if (!glfwInit())
+	{
+		std::cout << "Failed to initialize GLFW" << std::endl;
+		PrintHeadlessRequirements(headless);
+		return;
+	}
+
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	//glfwWindowHint(GLFW_SAMPLES, 4);
 
+	// Before GLFW 3.4 there is no null platform, so headless runs use a hidden window on the native one, which still needs a display
+	if (headless)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+	}
+
 	this->viewportWidth = this->windowWidth = width;
 	this->viewportHeight = this->windowHeight = height;
 
@@ -26,6 +62,7 @@ Window::Window(const char* title, float width, float height)
 	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window" << std::endl;
+		PrintHeadlessRequirements(headless);
 		glfwTerminate();
 		return;
 	}
@@ -8,7 +8,8 @@ struct GLFWwindow;
 class Window
 {
 public:
-	Window(const char* title, float width, float height);
+	// A headless window is never shown and only provides a context for rendering offscreen, e.g. for benchmarks
+	Window(const char* title, float width, float height, bool headless = false);
 	~Window();
 	void ProcessInput();
 	bool isOpen;
@@ -1,7 +1,7 @@
 #version 430 core
 
-const int numLights = 256;
-const int numClusters = 512;
+// Must match MAX_LIGHTS_PER_CLUSTER in LightSettings.hpp
+const uint maxLightsPerCluster = 512;
 
 struct Cluster
 {
@@ -29,30 +29,52 @@ struct SpotLight
 	float sl_padding[1];
 };
 
+struct ClusterLights
+{
+	uint pointLightOffset;
+	uint pointLightCount;
+	uint spotLightOffset;
+	uint spotLightCount;
+};
+
 layout (std430, binding = 0) buffer ClusterBuffer
 {
 	Cluster clusters[];
 };
 
-layout(std430, binding = 1) buffer PointLightBuffer
+layout(std430, binding = 1) readonly buffer PointLightBuffer
+{
+	PointLight pointLights[];
+};
+
+layout(std430, binding = 2) readonly buffer SpotLightBuffer
+{
+	SpotLight spotLights[];
+};
+
+layout(std430, binding = 5) writeonly buffer ClusterLightsBuffer
 {
-	PointLight pointLights[numLights];
-	int clusterPointLightCount[numClusters];
-	int clusterPointLightIndices[numClusters][numLights];
+	ClusterLights clusterLights[];
 };
 
-layout(std430, binding = 2) buffer SpotLightBuffer
+layout(std430, binding = 6) buffer LightIndexBuffer
 {
-	SpotLight spotLights[numLights];
-	int clusterSpotLightCount[numClusters];
-	int clusterSpotLightIndices[numClusters][numLights];
+	uint lightIndexCount;
+	uint lightIndices[];
 };
 
 uniform uvec3 clusterSizes;
 uniform int numPointLights;
 uniform int numSpotLights;
+uniform int maxLightIndices;
 uniform mat4 view;
 
+shared uint sharedPointLightCount;
+shared uint sharedSpotLightCount;
+shared uint sharedOffset;
+shared uint sharedPointLights[maxLightsPerCluster];
+shared uint sharedSpotLights[maxLightsPerCluster];
+
 bool PointLightIntersectsCluster(vec3 pointLightPosition, float pointLightRadius, Cluster cluster)
 {
 	vec3 closest = max(cluster.minBounds.xyz, min(pointLightPosition, cluster.maxBounds.xyz));
@@ -76,36 +98,26 @@ bool SpotLightIntersectsCluster(vec3 position, vec3 direction, float range, floa
 	return !(angleCull || frontCull || backCull);
 }
 
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+// One work group per cluster; its threads split the lights between them and gather the hits in shared memory
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
 void main()
 {
-	uint clusterIndex = gl_GlobalInvocationID.z * clusterSizes.x * clusterSizes.y +
-                        gl_GlobalInvocationID.y * clusterSizes.x +
-                        gl_GlobalInvocationID.x;
-
-	/*vec3 min = vec3(-0.5f,-0.5f,-0.5f);
-	vec3 max = vec3(0.5f, 0.5f, 0.5f);
+	uint clusterIndex = gl_WorkGroupID.z * clusterSizes.x * clusterSizes.y +
+                        gl_WorkGroupID.y * clusterSizes.x +
+                        gl_WorkGroupID.x;
 
-	SpotLight spotLight = spotLights[0];
-
-	vec3 spotLightPositionView = (view * vec4(spotLight.position.xyz,1)).xyz;
-	spotLightPositionView.z = -spotLightPositionView.z;
-
-	vec3 spotLightDirectionView = (view * vec4(spotLight.direction.xyz,0)).xyz;
-	spotLightDirectionView.z = -spotLightDirectionView.z;
-	spotLightDirectionView = normalize(spotLightDirectionView);
+	if (gl_LocalInvocationIndex == 0)
+	{
+		sharedPointLightCount = 0;
+		sharedSpotLightCount = 0;
+	}
 
-	
-	p = spotLight.position;
-	d = normalize(spotLight.direction);
-	viewP = vec4(spotLightPositionView,1);
-	viewD = vec4(spotLightDirectionView,1);*/
+	memoryBarrierShared();
+	barrier();
 
 	Cluster cluster = clusters[clusterIndex];
 
-	int intersections = 0;
-
-	for (int i=0; i < numPointLights; i++)
+	for (uint i = gl_LocalInvocationIndex; i < uint(numPointLights); i += gl_WorkGroupSize.x)
 	{
 		PointLight pointLight = pointLights[i];
 
@@ -115,16 +127,14 @@ void main()
 
 		if (PointLightIntersectsCluster(pointLightPositionView, pointLight.radius, cluster))
 		{
-			clusterPointLightIndices[clusterIndex][intersections] = i;
-			++intersections;
+			uint slot = atomicAdd(sharedPointLightCount, 1);
+
+			if (slot < maxLightsPerCluster)
+				sharedPointLights[slot] = i;
 		}
 	}
 
-	clusterPointLightCount[clusterIndex] = intersections;
-
-	intersections = 0;
-
-	for (int i=0; i < numSpotLights; i++)
+	for (uint i = gl_LocalInvocationIndex; i < uint(numSpotLights); i += gl_WorkGroupSize.x)
 	{
 		SpotLight spotLight = spotLights[i];
 
@@ -134,13 +144,42 @@ void main()
 		vec3 spotLightDirectionView = (view * vec4(spotLight.direction.xyz,0)).xyz;
 		spotLightDirectionView.z = -spotLightDirectionView.z;
 		spotLightDirectionView = normalize(spotLightDirectionView);
-		
+
 		if (SpotLightIntersectsCluster(spotLightPositionView, spotLightDirectionView, spotLight.range, radians(spotLight.cutOff), cluster))
 		{
-			clusterSpotLightIndices[clusterIndex][intersections] = i;
-			++intersections;
+			uint slot = atomicAdd(sharedSpotLightCount, 1);
+
+			if (slot < maxLightsPerCluster)
+				sharedSpotLights[slot] = i;
 		}
 	}
 
-	clusterSpotLightCount[clusterIndex] = intersections;
+	memoryBarrierShared();
+	barrier();
+
+	// The cluster's run of the global list is reserved once, and trimmed if the list is full
+	if (gl_LocalInvocationIndex == 0)
+	{
+		uint pointLightCount = min(sharedPointLightCount, maxLightsPerCluster);
+		uint spotLightCount = min(sharedSpotLightCount, maxLightsPerCluster);
+		uint offset = atomicAdd(lightIndexCount, pointLightCount + spotLightCount);
+		uint available = offset < uint(maxLightIndices) ? uint(maxLightIndices) - offset : 0;
+
+		pointLightCount = min(pointLightCount, available);
+		spotLightCount = min(spotLightCount, available - pointLightCount);
+
+		sharedPointLightCount = pointLightCount;
+		sharedSpotLightCount = spotLightCount;
+		sharedOffset = offset;
+		clusterLights[clusterIndex] = ClusterLights(offset, pointLightCount, offset + pointLightCount, spotLightCount);
+	}
+
+	memoryBarrierShared();
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < sharedPointLightCount; i += gl_WorkGroupSize.x)
+		lightIndices[sharedOffset + i] = sharedPointLights[i];
+
+	for (uint i = gl_LocalInvocationIndex; i < sharedSpotLightCount; i += gl_WorkGroupSize.x)
+		lightIndices[sharedOffset + sharedPointLightCount + i] = sharedSpotLights[i];
 }
@@ -7,9 +7,26 @@ in vec3 aPos : POSITION;
 in vec2 aTexCoords : TEXCOORD;
 in vec3 aNormal : NORMAL;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	mat4 instanceModels[];
+};
+
+uniform int instanceOffset;
+
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+	uvec3 clusterCounts;
+};
 
 out vec3 ViewPos;
 out vec2 TexCoords;
@@ -19,6 +36,7 @@ out vec3 WorldPos;
 
 void main()
 {
+	mat4 model = instanceModels[instanceOffset + gl_InstanceID];
 	WorldPos = vec3(model * vec4(aPos, 1.0));
 
 	vec4 viewPos = view * model * vec4(aPos, 1.0);
@@ -38,14 +56,23 @@ void main()
 
 #version 430
 
-uniform float nearPlane;
-uniform float farPlane;
-uniform float screenWidth;
-uniform float screenHeight;
-uniform mat4 view;
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+	uvec3 clusterCounts;
+};
+
 uniform sampler2D mainTex;
 uniform samplerCube pointShadowMap;
-uniform samplerCubeArray shadowCubeMapArray;
+uniform sampler2D pointShadowAtlas;
 
 in vec3 WorldPos;
 in vec3 ViewPos;
@@ -55,10 +82,8 @@ in vec3 WSNormal;
 
 out vec4 FragColor;
 
-uniform vec2 clusterScreenSpaceSize;
-
-const int numLights = 256;
-const int numClusters = 512;
+// Must match NUM_GLOBAL_LIGHTS in LightSettings.hpp
+const int numGlobalLights = 256;
 
 struct Cluster
 {
@@ -107,24 +132,45 @@ layout(std430, binding = 0) buffer ClusterBuffer
 	Cluster clusters[];
 };
 
-layout(std430, binding = 1) buffer PointLightBuffer
+layout(std430, binding = 1) readonly buffer PointLightBuffer
+{
+	PointLight pointLights[];
+};
+
+layout(std430, binding = 2) readonly buffer SpotLightBuffer
+{
+	SpotLight spotLights[];
+};
+
+// Per cluster: offset and count of its point lights, then of its spot lights, in lightIndices
+layout(std430, binding = 5) readonly buffer ClusterLightsBuffer
+{
+	uvec4 clusterLights[];
+};
+
+layout(std430, binding = 6) readonly buffer LightIndexBuffer
 {
-	PointLight pointLights[numLights];
-	int clusterPointLightCount[numClusters];
-	int clusterPointLightIndices[numClusters][numLights];
+	uint lightIndexCount;
+	uint lightIndices[];
 };
 
-layout(std430, binding = 2) buffer SpotLightBuffer
+// Indexed like pointLights: where each light's cube faces are in the shadow atlas, no shadow map when tileSize is 0
+struct PointShadow
 {
-	SpotLight spotLights[numLights];
-	int clusterSpotLightCount[numClusters];
-	int clusterSpotLightIndices[numClusters][numLights];
+	vec4 faceOffsets[3];
+	float tileSize;
+	float ps_padding[3];
+};
+
+layout(std430, binding = 7) readonly buffer PointShadowBuffer
+{
+	PointShadow pointShadows[];
 };
 
 layout(std430, binding = 3) buffer GlobalLightBuffer
 {
-	AmbientLight ambientLights[numLights];
-	DirectionalLight directionalLights[numLights];
+	AmbientLight ambientLights[numGlobalLights];
+	DirectionalLight directionalLights[numGlobalLights];
 	int numberOfAmbientLights;
 	int numberOfDirectionalLights;
 	int glb_padding[2];
@@ -139,8 +185,8 @@ float Screen2EyeDepth(float depth, float near, float far)
 
 uint GetClusterZIndex(float screenDepth)
 {
-	float scale = float(8) / log(farPlane / nearPlane);
-	float bias = -(float(8) * log(nearPlane) / log(farPlane / nearPlane));
+	float scale = float(clusterCounts.z) / log(farPlane / nearPlane);
+	float bias = -(float(clusterCounts.z) * log(nearPlane) / log(farPlane / nearPlane));
 
 	float eyeDepth = Screen2EyeDepth(screenDepth, nearPlane, farPlane);
 	uint zIndex = uint(max(log(eyeDepth) * scale + bias, 0.0));
@@ -151,7 +197,7 @@ uint GetClusterIndex(vec4 fragCoord)
 {
 	uint zIndex = GetClusterZIndex(fragCoord.z);
 	uvec3 indices = uvec3(uvec2(fragCoord.xy / clusterScreenSpaceSize), zIndex);
-	uint cluster = (8 * 8) * indices.z + 8 * indices.y + indices.x;
+	uint cluster = (clusterCounts.x * clusterCounts.y) * indices.z + clusterCounts.x * indices.y + indices.x;
 	return cluster;
 }
 
@@ -164,8 +210,50 @@ vec3 gridSamplingDisk[20] = vec3[]
 	vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, -1, -1), vec3(0, 1, -1)
 );
 
+// Same face selection and orientation as cube map sampling, so the tiles are read the way the faces were rendered
+vec2 GetShadowAtlasCoords(vec3 direction, PointShadow pointShadow, float texelSize)
+{
+	vec3 absolute = abs(direction);
+	int face;
+	float majorAxis;
+	vec2 faceCoords;
+
+	if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+	{
+		face = direction.x > 0.0 ? 0 : 1;
+		majorAxis = absolute.x;
+		faceCoords = direction.x > 0.0 ? vec2(-direction.z, -direction.y) : vec2(direction.z, -direction.y);
+	}
+	else if (absolute.y >= absolute.z)
+	{
+		face = direction.y > 0.0 ? 2 : 3;
+		majorAxis = absolute.y;
+		faceCoords = direction.y > 0.0 ? vec2(direction.x, direction.z) : vec2(direction.x, -direction.z);
+	}
+	else
+	{
+		face = direction.z > 0.0 ? 4 : 5;
+		majorAxis = absolute.z;
+		faceCoords = direction.z > 0.0 ? vec2(direction.x, -direction.y) : vec2(-direction.x, -direction.y);
+	}
+
+	vec4 offsets = pointShadow.faceOffsets[face / 2];
+	vec2 tileOffset = (face % 2 == 0) ? offsets.xy : offsets.zw;
+
+	// Kept half a texel inside the tile so filtering never reads a neighbouring one
+	vec2 tileCoords = faceCoords / majorAxis * 0.5 + 0.5;
+	float inset = 0.5 * texelSize / pointShadow.tileSize;
+	return tileOffset + clamp(tileCoords, inset, 1.0 - inset) * pointShadow.tileSize;
+}
+
 float ShadowCalculationPoint(vec3 fragPos, vec3 lightPos, float lightRadius, int lightIndex)
 {
+	PointShadow pointShadow = pointShadows[lightIndex];
+
+	if (pointShadow.tileSize == 0.0)
+		return 0.0;
+
+	float texelSize = 1.0 / float(textureSize(pointShadowAtlas, 0).x);
 	vec3 fragToLight = fragPos - lightPos;
 	float currentDepth = length(fragToLight);
 
@@ -178,9 +266,7 @@ float ShadowCalculationPoint(vec3 fragPos, vec3 lightPos, float lightRadius, int
 	for (int i = 0; i < samples; ++i)
 	{
 		vec3 index = fragToLight + gridSamplingDisk[i] * diskRadius;
-		float closestDepth = texture(shadowCubeMapArray, vec4(index, lightIndex)).r;
-		//float closestDepth = texture(shadowCubeMapArray, vec4(index, 0)).r;
-		//float closestDepth = texture(pointShadowMap, fragToLight + gridSamplingDisk[i] * diskRadius).r;
+		float closestDepth = texture(pointShadowAtlas, GetShadowAtlasCoords(index, pointShadow, texelSize)).r;
 		closestDepth *= lightRadius;   // undo mapping [0;1]
 		if (currentDepth - bias > closestDepth)
 			shadow += 1.0;
@@ -221,9 +307,11 @@ vec3 GetLighting(vec4 fragCoord)
 	}
 
 	// Point Lights
-	for (int i=0; i < clusterPointLightCount[clusterIndex]; i++)
+	uvec4 lights = clusterLights[clusterIndex];
+
+	for (uint i = 0; i < lights.y; i++)
 	{
-		int pointLightIndex = clusterPointLightIndices[clusterIndex][i];
+		int pointLightIndex = int(lightIndices[lights.x + i]);
 		PointLight light = pointLights[pointLightIndex];
 
 		float dist = length(light.position.xyz - WorldPos);
@@ -249,9 +337,9 @@ vec3 GetLighting(vec4 fragCoord)
 	}
 
 	// Spot Lights
-	for (int i = 0; i < clusterSpotLightCount[clusterIndex]; i++)
+	for (uint i = 0; i < lights.w; i++)
 	{
-		int spotLightIndex = clusterSpotLightIndices[clusterIndex][i];
+		uint spotLightIndex = lightIndices[lights.z + i];
 		SpotLight light = spotLights[spotLightIndex];
 
 		float dist = length(light.position.xyz - WorldPos);
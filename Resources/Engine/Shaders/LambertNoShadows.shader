@@ -7,9 +7,26 @@ in vec3 aPos : POSITION;
 in vec2 aTexCoords : TEXCOORD;
 in vec3 aNormal : NORMAL;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	mat4 instanceModels[];
+};
+
+uniform int instanceOffset;
+
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+	uvec3 clusterCounts;
+};
 
 out vec3 ViewPos;
 out vec2 TexCoords;
@@ -19,6 +36,7 @@ out vec3 WorldPos;
 
 void main()
 {
+	mat4 model = instanceModels[instanceOffset + gl_InstanceID];
 	WorldPos = vec3(model * vec4(aPos, 1.0));
 
 	vec4 viewPos = view * model * vec4(aPos, 1.0);
@@ -38,11 +56,20 @@ void main()
 
 #version 430
 
-uniform float nearPlane;
-uniform float farPlane;
-uniform float screenWidth;
-uniform float screenHeight;
-uniform mat4 view;
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+	uvec3 clusterCounts;
+};
+
 uniform sampler2D mainTex;
 
 in vec3 WorldPos;
@@ -53,10 +80,8 @@ in vec3 WSNormal;
 
 out vec4 FragColor;
 
-uniform vec2 clusterScreenSpaceSize;
-
-const int numLights = 256;
-const int numClusters = 512;
+// Must match NUM_GLOBAL_LIGHTS in LightSettings.hpp
+const int numGlobalLights = 256;
 
 struct Cluster
 {
@@ -104,24 +129,32 @@ layout(std430, binding = 0) buffer ClusterBuffer
 	Cluster clusters[];
 };
 
-layout(std430, binding = 1) buffer PointLightBuffer
+layout(std430, binding = 1) readonly buffer PointLightBuffer
+{
+	PointLight pointLights[];
+};
+
+layout(std430, binding = 2) readonly buffer SpotLightBuffer
 {
-	PointLight pointLights[numLights];
-	int clusterPointLightCount[numClusters];
-	int clusterPointLightIndices[numClusters][numLights];
+	SpotLight spotLights[];
 };
 
-layout(std430, binding = 2) buffer SpotLightBuffer
+// Per cluster: offset and count of its point lights, then of its spot lights, in lightIndices
+layout(std430, binding = 5) readonly buffer ClusterLightsBuffer
 {
-	SpotLight spotLights[numLights];
-	int clusterSpotLightCount[numClusters];
-	int clusterSpotLightIndices[numClusters][numLights];
+	uvec4 clusterLights[];
+};
+
+layout(std430, binding = 6) readonly buffer LightIndexBuffer
+{
+	uint lightIndexCount;
+	uint lightIndices[];
 };
 
 layout(std430, binding = 3) buffer GlobalLightBuffer
 {
-	AmbientLight ambientLights[numLights];
-	DirectionalLight directionalLights[numLights];
+	AmbientLight ambientLights[numGlobalLights];
+	DirectionalLight directionalLights[numGlobalLights];
 	int numberOfAmbientLights;
 	int numberOfDirectionalLights;
 	int glb_padding[2];
@@ -136,8 +169,8 @@ float Screen2EyeDepth(float depth, float near, float far)
 
 uint GetClusterZIndex(float screenDepth)
 {
-	float scale = float(8) / log(farPlane / nearPlane);
-	float bias = -(float(8) * log(nearPlane) / log(farPlane / nearPlane));
+	float scale = float(clusterCounts.z) / log(farPlane / nearPlane);
+	float bias = -(float(clusterCounts.z) * log(nearPlane) / log(farPlane / nearPlane));
 
 	float eyeDepth = Screen2EyeDepth(screenDepth, nearPlane, farPlane);
 	uint zIndex = uint(max(log(eyeDepth) * scale + bias, 0.0));
@@ -148,7 +181,7 @@ uint GetClusterIndex(vec4 fragCoord)
 {
 	uint zIndex = GetClusterZIndex(fragCoord.z);
 	uvec3 indices = uvec3(uvec2(fragCoord.xy / clusterScreenSpaceSize), zIndex);
-	uint cluster = (8 * 8) * indices.z + 8 * indices.y + indices.x;
+	uint cluster = (clusterCounts.x * clusterCounts.y) * indices.z + clusterCounts.x * indices.y + indices.x;
 	return cluster;
 }
 
@@ -182,9 +215,11 @@ vec3 GetLighting(vec4 fragCoord)
 	}
 
 	// Point Lights
-	for (int i=0; i < clusterPointLightCount[clusterIndex]; i++)
+	uvec4 lights = clusterLights[clusterIndex];
+
+	for (uint i = 0; i < lights.y; i++)
 	{
-		int pointLightIndex = clusterPointLightIndices[clusterIndex][i];
+		int pointLightIndex = int(lightIndices[lights.x + i]);
 		PointLight light = pointLights[pointLightIndex];
 
 		float dist = length(light.position.xyz - WorldPos);
@@ -204,9 +239,9 @@ vec3 GetLighting(vec4 fragCoord)
 	}
 
 	// Spot Lights
-	for (int i = 0; i < clusterSpotLightCount[clusterIndex]; i++)
+	for (uint i = 0; i < lights.w; i++)
 	{
-		int spotLightIndex = clusterSpotLightIndices[clusterIndex][i];
+		uint spotLightIndex = lightIndices[lights.z + i];
 		SpotLight light = spotLights[spotLightIndex];
 
 		float dist = length(light.position.xyz - WorldPos);
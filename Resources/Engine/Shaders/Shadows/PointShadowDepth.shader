@@ -2,16 +2,22 @@
 // Begin Vertex Shader
 // ============================================
 
-#version 330
+#version 430
 in vec3 aPos : POSITION;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	mat4 instanceModels[];
+};
+
+uniform int instanceOffset;
 
 out vec4 FragPos;
 
 void main()
 {
+	mat4 model = instanceModels[instanceOffset + gl_InstanceID];
 	FragPos = model * vec4(aPos, 1.0);
 	gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
 }
@@ -0,0 +1,62 @@
+// ============================================
+// Begin Vertex Shader
+// ============================================
+
+#version 430
+in vec3 aPos : POSITION;
+
+uniform mat4 lightSpaceMatrix;
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	mat4 instanceModels[];
+};
+
+uniform int instanceOffset;
+
+layout(location = 5) in ivec4 a_BoneIndices;
+layout(location = 6) in vec4 a_BoneWeights;
+
+const int MAX_BONES = 100;
+
+layout(std140) uniform BonePalette
+{
+	mat4 boneTransforms[MAX_BONES];
+};
+
+out vec4 FragPos;
+
+void main()
+{
+	mat4 boneTransform = boneTransforms[a_BoneIndices[0]] * a_BoneWeights[0];
+	boneTransform += boneTransforms[a_BoneIndices[1]] * a_BoneWeights[1];
+	boneTransform += boneTransforms[a_BoneIndices[2]] * a_BoneWeights[2];
+	boneTransform += boneTransforms[a_BoneIndices[3]] * a_BoneWeights[3];
+
+	mat4 model = instanceModels[instanceOffset + gl_InstanceID] * boneTransform;
+	FragPos = model * vec4(aPos, 1.0);
+	gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+}
+
+// ============================================
+// Begin Fragment Shader
+// ============================================
+
+#version 330 core
+in vec4 FragPos;
+
+uniform vec3 lightPos;
+uniform float lightRadius;
+
+//out vec4 FragColor;
+//out float gl_FragDepth;
+
+void main()
+{             
+    /*float lightDistance = length(FragPos.xyz - lightPos);
+    lightDistance = lightDistance / lightRadius;
+	FragColor = vec4(vec3(lightDistance),1);*/
+
+    float lightDistance = length(FragPos.xyz - lightPos);
+    lightDistance = lightDistance / lightRadius;
+    gl_FragDepth = lightDistance;
+}
\ No newline at end of file
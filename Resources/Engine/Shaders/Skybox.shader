@@ -5,8 +5,18 @@
 #version 330 core
 in vec3 aPos : POSITION;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+};
 
 out vec3 WorldPos;
 
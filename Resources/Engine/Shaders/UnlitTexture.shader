@@ -2,18 +2,35 @@
 // Begin Vertex Shader
 // ============================================
 
-#version 330 core
+#version 430 core
 in vec3 aPos : POSITION;
 in vec2 aTexCoord : TEXCOORD;
 
 out vec2 TexCoord;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	mat4 instanceModels[];
+};
+
+uniform int instanceOffset;
+
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+};
 
 void main()
 {
+	mat4 model = instanceModels[instanceOffset + gl_InstanceID];
 	gl_Position = projection * view * model * vec4(aPos, 1.0f);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
@@ -9,21 +9,36 @@ in vec2 aTexCoord : TEXCOORD;
 out vec2 TexCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout(std140) uniform ViewData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 camPos;
+	float nearPlane;
+	float farPlane;
+	float screenWidth;
+	float screenHeight;
+	vec2 clusterScreenSpaceSize;
+	float ambientLighting;
+};
 
 layout(location = 5) in ivec4 a_BoneIndices;
 layout(location = 6) in vec4 a_BoneWeights;
 
 const int MAX_BONES = 100;
-uniform mat4 u_BoneTransforms[100];
+
+layout(std140) uniform BonePalette
+{
+	mat4 boneTransforms[MAX_BONES];
+};
 
 void main()
 {
-	mat4 boneTransform = u_BoneTransforms[a_BoneIndices[0]] * a_BoneWeights[0];
-	boneTransform += u_BoneTransforms[a_BoneIndices[1]] * a_BoneWeights[1];
-	boneTransform += u_BoneTransforms[a_BoneIndices[2]] * a_BoneWeights[2];
-	boneTransform += u_BoneTransforms[a_BoneIndices[3]] * a_BoneWeights[3];
+	mat4 boneTransform = boneTransforms[a_BoneIndices[0]] * a_BoneWeights[0];
+	boneTransform += boneTransforms[a_BoneIndices[1]] * a_BoneWeights[1];
+	boneTransform += boneTransforms[a_BoneIndices[2]] * a_BoneWeights[2];
+	boneTransform += boneTransforms[a_BoneIndices[3]] * a_BoneWeights[3];
 
 	gl_Position = projection * view * model * boneTransform * vec4(aPos, 1.0f);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);